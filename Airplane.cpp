@@ -2,6 +2,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "BoundingBox.h"
+#include "Transform.hpp"
 
 class Airplane {
 private:
@@ -10,9 +11,18 @@ private:
     glm::vec3 forwardDirection;   // Forward direction of the airplane
     glm::vec3 rightDirection;     // Right direction of the airplane
     glm::vec3 upDirection;        // Up direction of the airplane
-    glm::mat4 modelMatrix;        // Model transformation matrix
-    GLuint modelMatrixLoc;        // Shader location for model matrix
-    BoundingBox boundingBox;      // Airplane bounding box    
+    gps::Transform transform;     // Model matrix and bounding box, rebuilt only when the airplane moves
+    glm::mat3 baseRotation;       // Turns the model to face forward, roll is applied after it
+    float transformRoll = 0.0f;   // Roll the transform rotation was built with
+    glm::vec3 previousPosition;   // State at the start of the last simulation step, rendering blends from it
+    glm::vec3 previousForwardDirection;
+    glm::vec3 previousUpDirection;
+    float previousRoll = 0.0f;
+    gps::Transform renderTransform; // Transform blended between the last two steps, only used for drawing
+    glm::vec3 renderPosition;
+    glm::vec3 renderForwardDirection;
+    glm::vec3 renderUpDirection;
+    float renderRoll = 0.0f;
     float gravity;                // Gravitational acceleration
     float groundLevel;            // Ground level
     float speed;                  // Current speed of the airplane
@@ -20,7 +30,7 @@ private:
     float maxSpeed;               // Maximum speed for the airplane
     float acceleration;           // Rate of acceleration
     float liftThreshold;          // Speed at which the airplane generates lift
-    float deltaTime = 0.016f;     // Time step for updates
+    float deltaTime = 0.016f;     // Fixed simulation step, main steps this many seconds at a time
     float drag = 0.98f;
     float yaw = 0.0f;
     float pitch = 0.0f;
@@ -28,7 +38,6 @@ private:
     float bankingSpeed = 15.0f;
     float maxBankingAngle = 15.0f;
     float maxYawAngle = 15.0f;
-    BoundingBox originalBoundingBox;
 
     void accelerate() {
         speed += acceleration * deltaTime;
@@ -47,11 +56,46 @@ private:
     }
 
 public:
-    Airplane(glm::vec3 startPosition, glm::mat4 initialModelMatrix, GLuint shaderModelLoc, BoundingBox initialBoundingBox, float groundY = 3.0f, float gravityAccel = -9.8f)
+    Airplane(glm::vec3 startPosition, BoundingBox initialBoundingBox, float groundY = 3.0f, float gravityAccel = -9.8f)
         : position(startPosition), velocity(0.0f), forwardDirection(glm::vec3(1.0f, 0.0f, 0.0f)),
         rightDirection(glm::vec3(0.0f, 0.0f, 1.0f)), upDirection(glm::vec3(0.0f, 1.0f, 0.0f)), gravity(gravityAccel), 
-        modelMatrix(initialModelMatrix), modelMatrixLoc(shaderModelLoc), boundingBox(initialBoundingBox), originalBoundingBox(initialBoundingBox),
-        groundLevel(groundY), speed(0.0f), maxSpeed(50.0f), minSpeed(0.0f), acceleration(10.0f), liftThreshold(15.0f) {}
+        groundLevel(groundY), speed(0.0f), maxSpeed(50.0f), minSpeed(0.0f), acceleration(10.0f), liftThreshold(15.0f) {
+        glm::mat4 base = glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        base = glm::rotate(base, glm::radians(-15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        baseRotation = glm::mat3(base);
+
+        transform.setScale(glm::vec3(2.0f, 2.0f, 2.0f));
+        transform.setRotation(baseRotation);
+        transform.setLocalBounds(initialBoundingBox);
+        updateTransform();
+
+        renderTransform.setScale(glm::vec3(2.0f, 2.0f, 2.0f));
+        renderTransform.setRotation(baseRotation);
+        beginStep();
+        interpolate(1.0f);
+    }
+
+    // Remembers the current state, call before each simulation step
+    void beginStep() {
+        previousPosition = position;
+        previousForwardDirection = forwardDirection;
+        previousUpDirection = upDirection;
+        previousRoll = roll;
+    }
+
+    // Places the render transform alpha of the way from the state before the last step to the current one
+    void interpolate(float alpha) {
+        renderPosition = glm::mix(previousPosition, position, alpha);
+        renderForwardDirection = glm::normalize(glm::mix(previousForwardDirection, forwardDirection, alpha));
+        renderUpDirection = glm::normalize(glm::mix(previousUpDirection, upDirection, alpha));
+
+        renderTransform.setPosition(renderPosition);
+        float blendedRoll = glm::mix(previousRoll, roll, alpha);
+        if (blendedRoll != renderRoll) {
+            renderTransform.setRotation(getRotation(blendedRoll));
+            renderRoll = blendedRoll;
+        }
+    }
 
     void applyGravity() {
         velocity.y += gravity * deltaTime;
@@ -62,7 +106,7 @@ public:
             velocity.y = 0.0f;
         }
 
-        updateModelMatrix();
+        updateTransform();
     }
 
     void moveForward(bool isAccelerating) {
@@ -77,7 +121,13 @@ public:
             applyDrag();
         }
         position += forwardDirection * speed * deltaTime;
-        updateModelMatrix();
+        updateTransform();
+    }
+
+    // Rolls forward on the ground at a constant speed, for airplanes the player doesn't fly
+    void taxi(float taxiSpeed) {
+        position += forwardDirection * taxiSpeed * deltaTime;
+        updateTransform();
     }
 
     void moveBackward(bool isAccelerating) {
@@ -88,7 +138,7 @@ public:
             applyDrag();
         }
         position -= -forwardDirection * speed * deltaTime;
-        updateModelMatrix();
+        updateTransform();
     }
 
     void turnLeft() {
@@ -99,7 +149,7 @@ public:
         yaw = glm::clamp(yaw, -maxYawAngle, maxYawAngle);
         std::cout << "Yaw: " << yaw << " degrees\n"; // Debug output
         updateOrientation();
-        updateModelMatrix();
+        updateTransform();
     }
 
     void turnRight() {
@@ -111,7 +161,7 @@ public:
         std::cout << "Yaw: " << yaw << " degrees\n"; // Debug output
         //if (yaw < -bankingSpeed) yaw = -bankingSpeed;
         updateOrientation();
-        updateModelMatrix();
+        updateTransform();
     }
 
     void levelRoll() {
@@ -125,7 +175,7 @@ public:
         }
         
         updateOrientation();
-        updateModelMatrix();
+        updateTransform();
     }
 
     void levelYaw() {
@@ -139,18 +189,21 @@ public:
         }
 
         updateOrientation();
-        updateModelMatrix();
+        updateTransform();
     }
 
-    void updateModelMatrix() {
-        modelMatrix = glm::translate(glm::mat4(1.0f), position);
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(-15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(roll), glm::vec3(1.0f, 0.0f, 0.0f));
+    // Only marks the transform dirty, the matrix and bounds are rebuilt when next read
+    void updateTransform() {
+        transform.setPosition(position);
+        if (roll != transformRoll) {
+            transform.setRotation(getRotation(roll));
+            transformRoll = roll;
+        }
+    }
 
-        boundingBox = originalBoundingBox;
-        boundingBox = boundingBox.transform(modelMatrix);
+    glm::mat3 getRotation(float rollAngle) const {
+        glm::mat4 rollRotation = glm::rotate(glm::mat4(1.0f), glm::radians(rollAngle), glm::vec3(1.0f, 0.0f, 0.0f));
+        return baseRotation * glm::mat3(rollRotation);
     }
 
     void updateOrientation() {
@@ -164,19 +217,19 @@ public:
         upDirection = glm::normalize(glm::cross(rightDirection, forwardDirection));
     }
 
-    void updateShader() const {
-        glUniformMatrix4fv(modelMatrixLoc, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+    void setBoundingBox(const BoundingBox& newBoundingBox) {
+        transform.setLocalBounds(newBoundingBox);
     }
 
     void setPosition(const glm::vec3& newPosition) {
         position = newPosition;
-        float lowestPoint = boundingBox.min.y;
+        float lowestPoint = transform.getWorldBounds().min.y;
         std::cout << lowestPoint;
         if (lowestPoint < groundLevel) {
             float correction = groundLevel - lowestPoint;
             position.y += correction;
         }
-        updateModelMatrix();
+        updateTransform();
     }
 
     glm::vec3 getPosition() const {
@@ -195,7 +248,41 @@ public:
         return speed;
     }
 
-    BoundingBox getBoundingBox() const{
-        return boundingBox;
+    float getTimeStep() const {
+        return deltaTime;
+    }
+
+    const glm::mat4& getModelMatrix() const {
+        return transform.getWorldMatrix();
+    }
+
+    // Inverse transpose of the model matrix
+    const glm::mat3& getNormalMatrix() const {
+        return transform.getNormalMatrix();
+    }
+
+    const BoundingBox& getBoundingBox() const{
+        return transform.getWorldBounds();
+    }
+
+    // Blended state from the last interpolate(), for the camera and drawing
+    glm::vec3 getRenderPosition() const {
+        return renderPosition;
+    }
+
+    glm::vec3 getRenderForwardDirection() const {
+        return renderForwardDirection;
+    }
+
+    glm::vec3 getRenderUpDirection() const {
+        return renderUpDirection;
+    }
+
+    const glm::mat4& getRenderModelMatrix() const {
+        return renderTransform.getWorldMatrix();
+    }
+
+    const glm::mat3& getRenderNormalMatrix() const {
+        return renderTransform.getNormalMatrix();
     }
 };
@@ -0,0 +1,294 @@
+#include "AssetBenchmark.hpp"
+#include "Model3D.hpp"
+#include "ObjLoader.hpp"
+#include "GLState.hpp"
+
+#include "json.hpp"
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+namespace gps {
+
+	static double nowMilliseconds() {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static size_t getFileSize(const std::string& fileName) {
+
+		std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+		return file ? (size_t)file.tellg() : 0;
+	}
+
+	double AssetStageResult::getMegabytesPerSecond() const {
+		return milliseconds > 0.0 ? bytes / (milliseconds * 1000.0) : 0.0;
+	}
+
+	void AssetBenchmark::setRepetitions(unsigned repetitions) {
+		this->repetitions = std::max(repetitions, 1u);
+	}
+
+	void AssetBenchmark::RunModel(const std::string& asset, const std::string& fileName, const std::string& basePath) {
+
+		std::cout << "Benchmarking : " << fileName << std::endl;
+		std::vector<double> times;
+
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+
+		for (unsigned r = 0; r < repetitions; r++) {
+
+			attrib = tinyobj::attrib_t();
+			shapes.clear();
+			materials.clear();
+			std::string err;
+
+			double start = nowMilliseconds();
+			bool ret = gps::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+			times.push_back(nowMilliseconds() - start);
+
+			if (!ret) {
+				fprintf(stderr, "ERROR: could not load %s\n", fileName.c_str());
+				return;
+			}
+		}
+		addResult(asset, fileName, "obj tokenize", getFileSize(fileName), times);
+
+		ModelData data;
+		times.clear();
+		for (unsigned r = 0; r < repetitions; r++) {
+
+			data.meshes.clear();
+			data.boundingBox = BoundingBox(glm::vec3(std::numeric_limits<float>::max()),
+				glm::vec3(std::numeric_limits<float>::lowest()));
+
+			double start = nowMilliseconds();
+			Model3D::BuildOBJMeshes(attrib, shapes, materials, basePath, data);
+			times.push_back(nowMilliseconds() - start);
+		}
+
+		const MeshData& mesh = data.meshes.back();
+		size_t meshBytes = mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(GLuint);
+		addResult(asset, fileName, "vertex build", meshBytes, times);
+
+		times.clear();
+		for (unsigned r = 0; r < repetitions; r++) {
+
+			double start = nowMilliseconds();
+			Mesh uploaded(mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), mesh.submeshes);
+			glFinish();
+			times.push_back(nowMilliseconds() - start);
+
+			uploaded.Release();
+		}
+		addResult(asset, fileName, "setupMesh", meshBytes, times);
+
+		// Every texture once, as DecodeTextures does
+		std::vector<std::string> texturePaths;
+		for (size_t sm = 0; sm < mesh.submeshes.size(); sm++) {
+
+			const std::vector<Texture>& textures = mesh.submeshes[sm].textures;
+			for (size_t t = 0; t < textures.size(); t++) {
+
+				if (std::find(texturePaths.begin(), texturePaths.end(), textures[t].path) == texturePaths.end()) {
+					texturePaths.push_back(textures[t].path);
+				}
+			}
+		}
+
+		size_t firstTexture = results.size();
+		for (size_t t = 0; t < texturePaths.size(); t++) {
+			RunTexture(asset, texturePaths[t]);
+		}
+
+		// The texture stages summed over the model, the time its textures take to load
+		const char* textureStages[3] = { "stbi_load", "row flip", "texture upload" };
+		for (int s = 0; s < 3; s++) {
+
+			AssetStageResult total = { asset, "all textures", textureStages[s], 0, 0.0 };
+			for (size_t i = firstTexture; i < results.size(); i++) {
+
+				if (results[i].stage == total.stage) {
+					total.bytes += results[i].bytes;
+					total.milliseconds += results[i].milliseconds;
+				}
+			}
+
+			if (total.bytes > 0) {
+				results.push_back(total);
+			}
+		}
+	}
+
+	void AssetBenchmark::RunTexture(const std::string& asset, const std::string& fileName) {
+
+		std::vector<double> times;
+		TextureImage image;
+		image.pixels = NULL;
+
+		for (unsigned r = 0; r < repetitions; r++) {
+
+			FreeImage(image);
+
+			double start = nowMilliseconds();
+			image = DecodeImage(fileName);
+			times.push_back(nowMilliseconds() - start);
+
+			if (!image.pixels) {
+				return;
+			}
+		}
+		addResult(asset, fileName, "stbi_load", getFileSize(fileName), times);
+
+		size_t pixelBytes = (size_t)image.width * image.height * 4;
+
+		// Flipped back and forth, every run moves the same bytes
+		times.clear();
+		for (unsigned r = 0; r < repetitions; r++) {
+
+			double start = nowMilliseconds();
+			FlipImageRows(image);
+			times.push_back(nowMilliseconds() - start);
+		}
+		addResult(asset, fileName, "row flip", pixelBytes, times);
+
+		times.clear();
+		for (unsigned r = 0; r < repetitions; r++) {
+
+			double start = nowMilliseconds();
+			GLuint texture = UploadTexture(image);
+			glFinish();
+			times.push_back(nowMilliseconds() - start);
+
+			GLState::forgetTexture(texture);
+			glDeleteTextures(1, &texture);
+		}
+		addResult(asset, fileName, "texture upload", pixelBytes, times);
+
+		FreeImage(image);
+	}
+
+	bool AssetBenchmark::WriteGridObj(const std::string& fileName, unsigned gridSize) {
+
+		FILE* file = fopen(fileName.c_str(), "w");
+		if (!file) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			return false;
+		}
+
+		unsigned side = gridSize + 1;
+		for (unsigned z = 0; z < side; z++) {
+			for (unsigned x = 0; x < side; x++) {
+
+				float height = 2.0f * std::sin(x * 0.05f) * std::cos(z * 0.07f);
+				fprintf(file, "v %.6f %.6f %.6f\n", (float)x, height, (float)z);
+				fprintf(file, "vt %.6f %.6f\n", (float)x / gridSize, (float)z / gridSize);
+				fprintf(file, "vn 0.0 1.0 0.0\n");
+			}
+		}
+
+		// Counter-clockwise seen from above, .obj indices start at 1
+		for (unsigned z = 0; z < gridSize; z++) {
+			for (unsigned x = 0; x < gridSize; x++) {
+
+				unsigned a = z * side + x + 1;
+				unsigned b = a + side;
+				fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+					a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1, a + 1);
+			}
+		}
+
+		bool written = ferror(file) == 0;
+		fclose(file);
+		return written;
+	}
+
+	bool AssetBenchmark::WriteNoiseImage(const std::string& fileName, int size) {
+
+		std::vector<unsigned char> pixels((size_t)size * size * 4);
+
+		// Fixed seed linear congruential noise over gradients, compresses about like a photo texture
+		uint32_t seed = 12345;
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+
+				unsigned char* pixel = &pixels[((size_t)y * size + x) * 4];
+				for (int c = 0; c < 3; c++) {
+
+					seed = seed * 1664525u + 1013904223u;
+					int gradient = (c == 0 ? x : c == 1 ? y : x + y) * 255 / (2 * size);
+					pixel[c] = (unsigned char)std::min(255, gradient + (int)(seed >> 29));
+				}
+				pixel[3] = 255;
+			}
+		}
+
+		if (!stbi_write_png(fileName.c_str(), size, size, 4, pixels.data(), size * 4)) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	const std::vector<AssetStageResult>& AssetBenchmark::getResults() const {
+		return results;
+	}
+
+	void AssetBenchmark::setInfo(const std::string& key, const std::string& value) {
+		info[key] = value;
+	}
+
+	std::string AssetBenchmark::toJson() const {
+
+		nlohmann::json report;
+		report["repetitions"] = repetitions;
+		report["stages"] = nlohmann::json::array();
+		for (size_t i = 0; i < results.size(); i++) {
+
+			nlohmann::json stage;
+			stage["asset"] = results[i].asset;
+			stage["file"] = results[i].file;
+			stage["stage"] = results[i].stage;
+			stage["bytes"] = results[i].bytes;
+			stage["ms"] = results[i].milliseconds;
+			stage["mbPerSecond"] = results[i].getMegabytesPerSecond();
+			report["stages"].push_back(stage);
+		}
+		for (std::map<std::string, std::string>::const_iterator it = info.begin(); it != info.end(); ++it) {
+			report["info"][it->first] = it->second;
+		}
+		return report.dump(2);
+	}
+
+	bool AssetBenchmark::WriteJson(const std::string& fileName) const {
+
+		std::ofstream file(fileName.c_str());
+		if (!file) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			return false;
+		}
+		file << toJson() << std::endl;
+		return true;
+	}
+
+	void AssetBenchmark::addResult(const std::string& asset, const std::string& file, const std::string& stage,
+		size_t bytes, std::vector<double> times) {
+
+		std::sort(times.begin(), times.end());
+
+		AssetStageResult result;
+		result.asset = asset;
+		result.file = file;
+		result.stage = stage;
+		result.bytes = bytes;
+		result.milliseconds = times.empty() ? 0.0 : times[times.size() / 2];
+		results.push_back(result);
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef AssetBenchmark_hpp
+#define AssetBenchmark_hpp
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // One loading stage run on one file, the median of the repetitions
+    struct AssetStageResult {
+
+        std::string asset;
+        std::string file;
+        std::string stage;
+        // Bytes the stage consumes or produces, see AssetBenchmark
+        size_t bytes;
+        double milliseconds;
+
+        // 10^6 bytes per second
+        double getMegabytesPerSecond() const;
+    };
+
+    // Times each stage of the asset pipeline on its own, without the mesh cache, so a change
+    // shows up in the stage it affects:
+    //   obj tokenize    .obj file bytes           gps::LoadObjParallel
+    //   vertex build    vertex and index bytes    Model3D::BuildOBJMeshes
+    //   stbi_load       image file bytes          DecodeImage
+    //   row flip        RGBA bytes                FlipImageRows
+    //   texture upload  RGBA bytes                UploadTexture (glTexImage2D, glGenerateMipmap)
+    //   setupMesh       vertex and index bytes    Mesh constructor
+    // GL stages end with glFinish and need a current context.
+    class AssetBenchmark {
+
+    public:
+        // Runs of each stage, the median is reported
+        void setRepetitions(unsigned repetitions);
+
+        // Runs every stage on an .obj file and on each texture its materials reference
+        void RunModel(const std::string& asset, const std::string& fileName, const std::string& basePath);
+
+        // Runs the texture stages on an image file
+        void RunTexture(const std::string& asset, const std::string& fileName);
+
+        // Scale-up assets, the same bytes on every run. A gridSize x gridSize quad terrain:
+        static bool WriteGridObj(const std::string& fileName, unsigned gridSize);
+        // A size x size RGBA PNG of noisy gradients:
+        static bool WriteNoiseImage(const std::string& fileName, int size);
+
+        const std::vector<AssetStageResult>& getResults() const;
+
+        // Describes the run in the report (renderer, ...)
+        void setInfo(const std::string& key, const std::string& value);
+
+        // Results in the order they ran, and the info, as JSON
+        std::string toJson() const;
+
+        bool WriteJson(const std::string& fileName) const;
+
+    private:
+        unsigned repetitions = 5;
+        std::vector<AssetStageResult> results;
+        std::map<std::string, std::string> info;
+
+        // Records the median of times (milliseconds)
+        void addResult(const std::string& asset, const std::string& file, const std::string& stage,
+            size_t bytes, std::vector<double> times);
+    };
+}
+
+#endif /* AssetBenchmark_hpp */
@@ -0,0 +1,91 @@
+#include "FrameStatistics.hpp"
+
+#include "json.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace gps {
+
+	// Nearest rank, the smallest value with at least percentile % of the values at or below it
+	template <typename T>
+	static T percentileOf(std::vector<T> values, double percentile) {
+
+		if (values.empty()) {
+			return T();
+		}
+		std::sort(values.begin(), values.end());
+		size_t rank = (size_t)std::ceil(percentile / 100.0 * values.size());
+		return values[rank > 0 ? rank - 1 : 0];
+	}
+
+	template <typename T>
+	static double meanOf(const std::vector<T>& values) {
+
+		if (values.empty()) {
+			return 0.0;
+		}
+		double sum = 0.0;
+		for (size_t i = 0; i < values.size(); i++) {
+			sum += (double)values[i];
+		}
+		return sum / values.size();
+	}
+
+	template <typename T>
+	static nlohmann::json summarize(const std::vector<T>& values) {
+
+		nlohmann::json summary;
+		summary["mean"] = meanOf(values);
+		summary["p50"] = percentileOf(values, 50.0);
+		summary["p95"] = percentileOf(values, 95.0);
+		summary["p99"] = percentileOf(values, 99.0);
+		summary["max"] = percentileOf(values, 100.0);
+		return summary;
+	}
+
+	void FrameStatistics::addFrame(double frameTimeMs, size_t drawCalls, size_t triangles) {
+
+		frameTimes.push_back(frameTimeMs);
+		this->drawCalls.push_back(drawCalls);
+		this->triangles.push_back(triangles);
+	}
+
+	size_t FrameStatistics::getFrameCount() const {
+		return frameTimes.size();
+	}
+
+	double FrameStatistics::getFrameTimePercentile(double percentile) const {
+		return percentileOf(frameTimes, percentile);
+	}
+
+	void FrameStatistics::setInfo(const std::string& key, const std::string& value) {
+		info[key] = value;
+	}
+
+	std::string FrameStatistics::toJson() const {
+
+		nlohmann::json report;
+		report["frames"] = frameTimes.size();
+		report["frameTimeMs"] = summarize(frameTimes);
+		report["drawCallsPerFrame"] = summarize(drawCalls);
+		report["trianglesPerFrame"] = summarize(triangles);
+		for (std::map<std::string, std::string>::const_iterator it = info.begin(); it != info.end(); ++it) {
+			report["info"][it->first] = it->second;
+		}
+		return report.dump(2);
+	}
+
+	bool FrameStatistics::WriteJson(const std::string& fileName) const {
+
+		std::ofstream file(fileName.c_str());
+		if (!file) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			return false;
+		}
+		file << toJson() << std::endl;
+		return true;
+	}
+}
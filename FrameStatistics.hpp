@@ -0,0 +1,38 @@
+#ifndef FrameStatistics_hpp
+#define FrameStatistics_hpp
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Per frame measurements of a benchmark run, summarized as percentiles
+    class FrameStatistics {
+
+    public:
+        void addFrame(double frameTimeMs, size_t drawCalls, size_t triangles);
+
+        size_t getFrameCount() const;
+
+        // Nearest rank percentile of the frame times, percentile in [0, 100]
+        double getFrameTimePercentile(double percentile) const;
+
+        // Describes the run in the report (renderer, resolution, ...)
+        void setInfo(const std::string& key, const std::string& value);
+
+        // Frame time percentiles, draw calls and triangles per frame, and the info, as JSON
+        std::string toJson() const;
+
+        bool WriteJson(const std::string& fileName) const;
+
+    private:
+        std::vector<double> frameTimes;
+        std::vector<size_t> drawCalls;
+        std::vector<size_t> triangles;
+        std::map<std::string, std::string> info;
+    };
+}
+
+#endif /* FrameStatistics_hpp */
@@ -0,0 +1,113 @@
+#include "Framebuffer.hpp"
+
+#include "stb_image_write.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace gps {
+
+	Framebuffer::Framebuffer() : framebuffer(0), colorBuffer(0), depthBuffer(0), width(0), height(0) {
+	}
+
+	Framebuffer::~Framebuffer() {
+		destroy();
+	}
+
+	void Framebuffer::destroy() {
+
+		if (framebuffer) {
+			glDeleteFramebuffers(1, &framebuffer);
+			glDeleteRenderbuffers(1, &colorBuffer);
+			glDeleteRenderbuffers(1, &depthBuffer);
+			framebuffer = 0;
+			colorBuffer = 0;
+			depthBuffer = 0;
+		}
+	}
+
+	bool Framebuffer::init(int width, int height) {
+
+		this->width = width;
+		this->height = height;
+
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		// sRGB, like the window's default framebuffer, since GL_FRAMEBUFFER_SRGB is on
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: framebuffer incomplete (0x%x)\n", status);
+			return false;
+		}
+
+		return true;
+	}
+
+	void Framebuffer::bind() const {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+
+	int Framebuffer::getWidth() const {
+		return width;
+	}
+
+	int Framebuffer::getHeight() const {
+		return height;
+	}
+
+	void Framebuffer::readPixels(std::vector<unsigned char>& pixels) const {
+
+		size_t rowSize = (size_t)width * 4;
+		pixels.resize(rowSize * height);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+		// GL returns the bottom row first
+		std::vector<unsigned char> row(rowSize);
+		for (int y = 0; y < height / 2; y++) {
+			unsigned char* top = &pixels[y * rowSize];
+			unsigned char* bottom = &pixels[(height - 1 - y) * rowSize];
+			memcpy(row.data(), top, rowSize);
+			memcpy(top, bottom, rowSize);
+			memcpy(bottom, row.data(), rowSize);
+		}
+	}
+
+	bool Framebuffer::SaveFrame(const std::string& fileName) const {
+
+		readPixels(pixels);
+
+		bool png = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".png") == 0;
+		if (png) {
+			if (!stbi_write_png(fileName.c_str(), width, height, 4, pixels.data(), width * 4)) {
+				fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+				return false;
+			}
+			return true;
+		}
+
+		FILE* file = fopen(fileName.c_str(), "wb");
+		if (!file) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			return false;
+		}
+		size_t written = fwrite(pixels.data(), 1, pixels.size(), file);
+		fclose(file);
+		return written == pixels.size();
+	}
+}
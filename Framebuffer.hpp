@@ -0,0 +1,56 @@
+#ifndef Framebuffer_hpp
+#define Framebuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Offscreen render target with an sRGB color buffer and a depth buffer, for rendering without a window
+    class Framebuffer {
+
+    public:
+        Framebuffer();
+        ~Framebuffer();
+
+        // Creates the buffers, returns false if the driver reports the framebuffer incomplete
+        bool init(int width, int height);
+
+        // Deletes the buffers while the context is still current, the destructor then has nothing left to do
+        void destroy();
+
+        // Makes it the target of the following draws
+        void bind() const;
+
+        int getWidth() const;
+        int getHeight() const;
+
+        // Reads back the color buffer as RGBA, 4 bytes per pixel, top row first
+        void readPixels(std::vector<unsigned char>& pixels) const;
+
+        // Writes the color buffer to a PNG when fileName ends in .png, otherwise as raw RGBA bytes
+        bool SaveFrame(const std::string& fileName) const;
+
+    private:
+        GLuint framebuffer;
+        GLuint colorBuffer;
+        GLuint depthBuffer;
+        int width;
+        int height;
+        // Reused between frames
+        mutable std::vector<unsigned char> pixels;
+
+        Framebuffer(const Framebuffer&);
+        Framebuffer& operator=(const Framebuffer&);
+    };
+}
+
+#endif /* Framebuffer_hpp */
@@ -0,0 +1,141 @@
+#include "Frustum.hpp"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define FRUSTUM_SSE
+    #include <xmmintrin.h>
+#endif
+
+namespace gps {
+
+	void BoxList::add(const BoundingBox& box) {
+
+		// Keep the arrays padded with empty boxes at the origin
+		if (count % 4 == 0) {
+			centerX.resize(count + 4, 0.0f);
+			centerY.resize(count + 4, 0.0f);
+			centerZ.resize(count + 4, 0.0f);
+			extentX.resize(count + 4, 0.0f);
+			extentY.resize(count + 4, 0.0f);
+			extentZ.resize(count + 4, 0.0f);
+		}
+
+		glm::vec3 center = (box.min + box.max) * 0.5f;
+		glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+		centerX[count] = center.x;
+		centerY[count] = center.y;
+		centerZ[count] = center.z;
+		extentX[count] = extent.x;
+		extentY[count] = extent.y;
+		extentZ[count] = extent.z;
+		count++;
+	}
+
+	Frustum::Frustum() {
+
+		for (int i = 0; i < 6; i++) {
+			planes[i] = glm::vec4(0.0f);
+		}
+	}
+
+	Frustum::Frustum(const glm::mat4& clipMatrix) {
+
+		// Rows of the clip matrix (glm is column major)
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++) {
+			rows[i] = glm::vec4(clipMatrix[0][i], clipMatrix[1][i], clipMatrix[2][i], clipMatrix[3][i]);
+		}
+
+		planes[0] = rows[3] + rows[0]; // left
+		planes[1] = rows[3] - rows[0]; // right
+		planes[2] = rows[3] + rows[1]; // bottom
+		planes[3] = rows[3] - rows[1]; // top
+		planes[4] = rows[3] + rows[2]; // near
+		planes[5] = rows[3] - rows[2]; // far
+	}
+
+	bool Frustum::isVisible(const BoundingBox& box) const {
+
+		glm::vec3 center = (box.min + box.max) * 0.5f;
+		glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+		for (int i = 0; i < 6; i++) {
+
+			const glm::vec4& plane = planes[i];
+			// Distance of the box corner furthest along the plane normal
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z +
+				std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+			if (distance < -plane.w) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	size_t Frustum::cullBoxes(const BoxList& boxes, unsigned char* visible) const {
+
+		size_t culled = 0;
+
+#ifdef FRUSTUM_SSE
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		__m128 planeX[6], planeY[6], planeZ[6], planeAbsX[6], planeAbsY[6], planeAbsZ[6], planeW[6];
+		for (int i = 0; i < 6; i++) {
+
+			planeX[i] = _mm_set1_ps(planes[i].x);
+			planeY[i] = _mm_set1_ps(planes[i].y);
+			planeZ[i] = _mm_set1_ps(planes[i].z);
+			planeAbsX[i] = _mm_andnot_ps(signMask, planeX[i]);
+			planeAbsY[i] = _mm_andnot_ps(signMask, planeY[i]);
+			planeAbsZ[i] = _mm_andnot_ps(signMask, planeZ[i]);
+			planeW[i] = _mm_set1_ps(-planes[i].w);
+		}
+
+		for (size_t b = 0; b < boxes.count; b += 4) {
+
+			__m128 centerX = _mm_loadu_ps(&boxes.centerX[b]);
+			__m128 centerY = _mm_loadu_ps(&boxes.centerY[b]);
+			__m128 centerZ = _mm_loadu_ps(&boxes.centerZ[b]);
+			__m128 extentX = _mm_loadu_ps(&boxes.extentX[b]);
+			__m128 extentY = _mm_loadu_ps(&boxes.extentY[b]);
+			__m128 extentZ = _mm_loadu_ps(&boxes.extentZ[b]);
+
+			__m128 outside = _mm_setzero_ps();
+			for (int i = 0; i < 6; i++) {
+
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(planeX[i], centerX), _mm_add_ps(_mm_mul_ps(planeY[i], centerY), _mm_mul_ps(planeZ[i], centerZ))),
+					_mm_add_ps(_mm_mul_ps(planeAbsX[i], extentX), _mm_add_ps(_mm_mul_ps(planeAbsY[i], extentY), _mm_mul_ps(planeAbsZ[i], extentZ))));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, planeW[i]));
+			}
+
+			int outsideMask = _mm_movemask_ps(outside);
+			for (size_t k = 0; k < 4 && b + k < boxes.count; k++) {
+
+				visible[b + k] = (outsideMask >> k) & 1 ? 0 : 1;
+				culled += 1 - visible[b + k];
+			}
+		}
+#else
+		for (size_t b = 0; b < boxes.count; b++) {
+
+			bool inside = true;
+			for (int i = 0; i < 6 && inside; i++) {
+
+				const glm::vec4& plane = planes[i];
+				float distance = plane.x * boxes.centerX[b] + plane.y * boxes.centerY[b] + plane.z * boxes.centerZ[b] +
+					std::abs(plane.x) * boxes.extentX[b] + std::abs(plane.y) * boxes.extentY[b] + std::abs(plane.z) * boxes.extentZ[b];
+				inside = distance >= -plane.w;
+			}
+
+			visible[b] = inside ? 1 : 0;
+			culled += 1 - visible[b];
+		}
+#endif
+
+		return culled;
+	}
+}
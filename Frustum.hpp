@@ -0,0 +1,46 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+
+#include <vector>
+
+namespace gps {
+
+    // Axis aligned boxes stored as separate center/extent arrays, padded to a multiple of 4
+    // so the frustum test can take them four at a time
+    struct BoxList {
+
+        std::vector<float> centerX, centerY, centerZ;
+        std::vector<float> extentX, extentY, extentZ;
+        size_t count = 0;
+
+        void add(const BoundingBox& box);
+    };
+
+    // The six planes of a view frustum, extracted from a clip matrix (Gribb-Hartmann).
+    // Built from projection * view * model, the planes live in model space.
+    class Frustum {
+
+    public:
+        // Empty frustum, everything is visible
+        Frustum();
+
+        explicit Frustum(const glm::mat4& clipMatrix);
+
+        // True when the box is at least partly inside
+        bool isVisible(const BoundingBox& box) const;
+
+        // Writes 1 for the boxes at least partly inside and 0 for the others, returns the number of culled boxes
+        size_t cullBoxes(const BoxList& boxes, unsigned char* visible) const;
+
+    private:
+        // a * x + b * y + c * z + d >= 0 inside
+        glm::vec4 planes[6];
+    };
+
+}
+
+#endif /* Frustum_hpp */
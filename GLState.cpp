@@ -0,0 +1,129 @@
+#include "GLState.hpp"
+
+namespace gps {
+
+	// Not a valid object name, forces the next bind through
+	static const GLuint unknownBinding = ~0u;
+	// Units past these aren't shadowed
+	static const GLuint maxTextureUnits = 32;
+
+	static GLuint currentProgram = unknownBinding;
+	static GLuint currentVertexArray = unknownBinding;
+	static GLuint currentUnit = unknownBinding;
+	static GLuint currentTextures[maxTextureUnits] = {
+		unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding,
+		unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding,
+		unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding,
+		unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding, unknownBinding
+	};
+	static GLStateStats stats = { 0, 0, 0, 0 };
+
+	// Switches the active unit without counting a request, for binds that already counted theirs
+	static void setActiveUnit(GLuint unit) {
+
+		if (unit != currentUnit) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			currentUnit = unit;
+		}
+	}
+
+	void GLState::useProgram(GLuint program) {
+
+		stats.requested++;
+		if (program == currentProgram) {
+			stats.skipped++;
+			return;
+		}
+		glUseProgram(program);
+		currentProgram = program;
+	}
+
+	void GLState::bindVertexArray(GLuint vertexArray) {
+
+		stats.requested++;
+		if (vertexArray == currentVertexArray) {
+			stats.skipped++;
+			return;
+		}
+		glBindVertexArray(vertexArray);
+		currentVertexArray = vertexArray;
+	}
+
+	void GLState::activeTexture(GLuint unit) {
+
+		stats.requested++;
+		if (unit == currentUnit) {
+			stats.skipped++;
+			return;
+		}
+		setActiveUnit(unit);
+	}
+
+	void GLState::bindTexture(GLuint unit, GLuint texture) {
+
+		stats.requested++;
+		if (unit < maxTextureUnits && currentTextures[unit] == texture) {
+			stats.skipped++;
+			return;
+		}
+		setActiveUnit(unit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		if (unit < maxTextureUnits) {
+			currentTextures[unit] = texture;
+		}
+	}
+
+	void GLState::unbindTextures(GLuint firstUnit) {
+
+		for (GLuint unit = firstUnit; unit < maxTextureUnits; unit++) {
+			if (currentTextures[unit] != 0) {
+				bindTexture(unit, 0);
+			}
+		}
+	}
+
+	void GLState::forgetVertexArray(GLuint vertexArray) {
+
+		if (vertexArray == currentVertexArray) {
+			currentVertexArray = 0;
+		}
+	}
+
+	void GLState::forgetTexture(GLuint texture) {
+
+		for (GLuint unit = 0; unit < maxTextureUnits; unit++) {
+			if (currentTextures[unit] == texture) {
+				currentTextures[unit] = 0;
+			}
+		}
+	}
+
+	void GLState::invalidate() {
+
+		currentProgram = unknownBinding;
+		currentVertexArray = unknownBinding;
+		currentUnit = unknownBinding;
+		for (GLuint unit = 0; unit < maxTextureUnits; unit++) {
+			currentTextures[unit] = unknownBinding;
+		}
+	}
+
+	void GLState::recordDraw(GLsizei vertexCount, GLsizei instanceCount) {
+
+		stats.drawCalls++;
+		stats.triangles += (size_t)(vertexCount / 3) * instanceCount;
+	}
+
+	GLStateStats GLState::getStats() {
+
+		return stats;
+	}
+
+	void GLState::resetStats() {
+
+		stats.requested = 0;
+		stats.skipped = 0;
+		stats.drawCalls = 0;
+		stats.triangles = 0;
+	}
+}
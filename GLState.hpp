@@ -0,0 +1,60 @@
+#ifndef GLState_hpp
+#define GLState_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+
+namespace gps {
+
+    // Binds asked for through GLState, and how many of them were already current,
+    // and the draws reported with recordDraw()
+    struct GLStateStats {
+
+        size_t requested;
+        size_t skipped;
+        size_t drawCalls;
+        size_t triangles;
+    };
+
+    // Shadow copy of the bound program, vertex array and 2D textures, so binds that
+    // wouldn't change anything never reach GL. Everything that binds these must go
+    // through here, or call invalidate() afterwards.
+    class GLState {
+
+    public:
+        static void useProgram(GLuint program);
+
+        static void bindVertexArray(GLuint vertexArray);
+
+        static void activeTexture(GLuint unit);
+
+        // Binds a 2D texture to a unit, switching the active unit only when the binding changes
+        static void bindTexture(GLuint unit, GLuint texture);
+
+        // Binds 0 to every unit from firstUnit up that still holds a texture
+        static void unbindTextures(GLuint firstUnit);
+
+        // Must be called when deleting objects, GL unbinds them behind our back
+        static void forgetVertexArray(GLuint vertexArray);
+        static void forgetTexture(GLuint texture);
+
+        // Counts a draw of vertexCount triangle list vertices, instanceCount times
+        static void recordDraw(GLsizei vertexCount, GLsizei instanceCount = 1);
+
+        // Forgets everything, the next binds all go through
+        static void invalidate();
+
+        // Counts since the last reset
+        static GLStateStats getStats();
+        static void resetStats();
+    };
+}
+
+#endif /* GLState_hpp */
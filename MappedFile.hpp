@@ -0,0 +1,38 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Read-only memory mapping of a whole file
+    class MappedFile {
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Maps the file into memory, returns false if it can't be opened or is empty
+        bool open(const std::string& fileName);
+
+        void close();
+
+        const unsigned char* data() const;
+        size_t size() const;
+
+    private:
+        const unsigned char* mappedData;
+        size_t mappedSize;
+#if defined (_WIN32)
+        void* fileHandle;
+        void* mappingHandle;
+#endif
+    };
+
+}
+
+#endif /* MappedFile_hpp */
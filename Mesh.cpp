@@ -1,72 +1,422 @@
 #include "Mesh.hpp"
+#include "RenderQueue.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Submesh> submeshes) {
 
 		this->vertices = vertices;
 		this->indices = indices;
-		this->textures = textures;
+		this->submeshes = submeshes;
+		this->quantized = false;
+
+		this->setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+		this->setupCulling();
+		this->setupMaterials();
+	}
+
+	Mesh::Mesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, std::vector<Submesh> submeshes) {
+
+		this->submeshes = submeshes;
+		this->quantized = false;
+
+		this->setupMesh(vertexData, vertexCount, indexData, indexCount);
+		this->setupCulling();
+		this->setupMaterials();
+	}
+
+	Mesh::Mesh(const QuantizedVertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, std::vector<Submesh> submeshes) {
+
+		this->submeshes = submeshes;
+		this->quantized = true;
+
+		this->setupMesh(vertexData, vertexCount, indexData, indexCount);
+		this->setupCulling();
+		this->setupMaterials();
+	}
+
+	Mesh::Mesh(const unsigned char* bufferData, size_t bufferSize, std::vector<Submesh> submeshes) {
+
+		this->submeshes = submeshes;
+		this->quantized = false;
+
+		this->setupRawMesh(bufferData, bufferSize);
+		this->setupCulling();
+		this->setupMaterials();
+	}
+
+	void Mesh::Release() {
+
+		glDeleteBuffers(1, &this->buffers.VBO);
+		glDeleteBuffers(1, &this->buffers.EBO);
+		GLState::forgetVertexArray(this->buffers.VAO);
+		glDeleteVertexArrays(1, &this->buffers.VAO);
+		this->buffers.VAO = this->buffers.VBO = this->buffers.EBO = 0;
+
+		for (size_t s = 0; s < this->submeshes.size(); s++) {
+
+			GLState::forgetVertexArray(this->submeshes[s].VAO);
+			glDeleteVertexArrays(1, &this->submeshes[s].VAO);
+			this->submeshes[s].VAO = 0;
+		}
+	}
+
+	size_t Mesh::Cull(const Frustum& frustum) {
+
+		size_t culled = frustum.cullBoxes(this->submeshBounds, this->visible.data());
+		if (this->rangeBounds.count > 0) {
+			culled += frustum.cullBoxes(this->rangeBounds, this->rangeVisible.data());
+		}
+		return culled;
+	}
+
+	size_t Mesh::getCullBoxCount() const {
+		return this->submeshBounds.count + this->rangeBounds.count;
+	}
+
+	void Mesh::ClearCulling() {
+		std::fill(this->visible.begin(), this->visible.end(), 1);
+		std::fill(this->rangeVisible.begin(), this->rangeVisible.end(), 1);
+	}
+
+	// Size in bytes of one index of the given type
+	GLsizeiptr getIndexSize(GLenum indexType) {
+		switch (indexType) {
+		case GL_UNSIGNED_BYTE: return sizeof(GLubyte);
+		case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+		default: return sizeof(GLuint);
+		}
+	}
 
-		this->setupMesh();
+	void setNodeUniforms(GLint matrixLoc, GLint normalMatrixLoc, const glm::mat4& nodeMatrix) {
+
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(nodeMatrix)));
+		glUniformMatrix4fv(matrixLoc, 1, GL_FALSE, glm::value_ptr(nodeMatrix));
+		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
-	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)	{
+	/* Mesh drawing function - draws every submesh from the shared buffers, applying its textures */
+	void Mesh::Draw(const gps::Shader& shader, unsigned lod)	{
 
-		shader.useShaderProgram();
+		this->DrawSubmeshes(shader, lod, NULL, 0);
+	}
+
+	void Mesh::DrawInstanced(const gps::Shader& shader, unsigned lod, const GLuint* vertexArrays, GLsizei instanceCount) const {
+
+		this->DrawSubmeshes(shader, lod, vertexArrays, instanceCount);
+	}
+
+	GLuint Mesh::getVertexArray(size_t submesh) const {
+
+		return this->submeshes[submesh].VAO ? this->submeshes[submesh].VAO : this->buffers.VAO;
+	}
+
+	GLuint Mesh::CreateVertexArray(size_t submesh) const {
+
+		const Submesh& source = this->submeshes[submesh];
+
+		GLuint VAO;
+		glGenVertexArrays(1, &VAO);
+		GLState::bindVertexArray(VAO);
+
+		if (source.VAO) {
+			// Raw buffer read through the attribute layout of the submesh
+			glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+			if (source.indexType != GL_NONE) {
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.VBO);
+			}
+			this->setupAttributes(source.attributes);
+		} else {
+			glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
+			this->setupVertexAttributes();
+		}
 
-		//set textures
-		for (GLuint i = 0; i < textures.size(); i++) {
+		return VAO;
+	}
+
+	// Draws the visible submeshes, or every submesh instanceCount times through vertexArrays when given
+	void Mesh::DrawSubmeshes(const gps::Shader& shader, unsigned lod, const GLuint* vertexArrays, GLsizei instanceCount) const {
+
+		shader.useShaderProgram();
 
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+		// Float meshes go through the same decoding with an identity range
+		GLint positionMinLoc = shader.getUniformLocation(UniformPositionMin);
+		GLint positionExtentLoc = shader.getUniformLocation(UniformPositionExtent);
+		glUniform1i(shader.getUniformLocation(UniformQuantizedVertices), this->quantized);
+		if (!this->quantized) {
+			glUniform3f(positionMinLoc, 0.0f, 0.0f, 0.0f);
+			glUniform3f(positionExtentLoc, 1.0f, 1.0f, 1.0f);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		// Set again only when the next submesh has another node
+		GLint nodeMatrixLoc = shader.getUniformLocation(UniformNodeMatrix);
+		GLint nodeNormalMatrixLoc = shader.getUniformLocation(UniformNodeNormalMatrix);
+		const glm::mat4* nodeMatrix = NULL;
+
+		for (size_t s = 0; s < this->submeshes.size(); s++) {
+
+			const Submesh& submesh = this->submeshes[s];
+			if (!vertexArrays && !this->visible[s]) {
+				continue;
+			}
+
+			GLState::bindVertexArray(vertexArrays ? vertexArrays[s] : this->getVertexArray(s));
+
+			if (!nodeMatrix || *nodeMatrix != submesh.nodeMatrix) {
+				nodeMatrix = &submesh.nodeMatrix;
+				setNodeUniforms(nodeMatrixLoc, nodeNormalMatrixLoc, submesh.nodeMatrix);
+			}
 
-        for(GLuint i = 0; i < this->textures.size(); i++) {
+			if (this->quantized) {
+				glm::vec3 extent = submesh.boundingBox.max - submesh.boundingBox.min;
+				glUniform3fv(positionMinLoc, 1, glm::value_ptr(submesh.boundingBox.min));
+				glUniform3fv(positionExtentLoc, 1, glm::value_ptr(extent));
+			}
 
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+			//set textures
+			for (GLuint i = 0; i < submesh.textures.size(); i++) {
 
+				glUniform1i(shader.getUniformLocation(submesh.textures[i].uniform), i);
+				GLState::bindTexture(i, submesh.textures[i].id);
+			}
+
+			// units left over from the previous draw must not leak into this one
+			GLState::unbindTextures((GLuint)submesh.textures.size());
+
+			if (submesh.indexType == GL_NONE) {
+				if (vertexArrays) {
+					glDrawArraysInstanced(GL_TRIANGLES, submesh.baseVertex, submesh.indexCount, instanceCount);
+				} else {
+					glDrawArrays(GL_TRIANGLES, submesh.baseVertex, submesh.indexCount);
+				}
+				GLState::recordDraw(submesh.indexCount, vertexArrays ? instanceCount : 1);
+			} else {
+				this->getDrawRuns(s, lod, !vertexArrays, this->drawRuns);
+				for (size_t r = 0; r < this->drawRuns.size(); r++) {
+
+					const SubmeshLod& run = this->drawRuns[r];
+					const GLvoid* offset = (GLvoid*)(run.firstIndex * getIndexSize(submesh.indexType));
+					if (vertexArrays) {
+						glDrawElementsInstancedBaseVertex(GL_TRIANGLES, run.indexCount, submesh.indexType, offset,
+							instanceCount, submesh.baseVertex);
+					} else {
+						glDrawElementsBaseVertex(GL_TRIANGLES, run.indexCount, submesh.indexType, offset, submesh.baseVertex);
+					}
+					GLState::recordDraw(run.indexCount, vertexArrays ? instanceCount : 1);
+				}
+			}
+		}
     }
 
+	// Index runs to draw of a submesh at the level of detail
+	void Mesh::getDrawRuns(size_t submesh, unsigned lod, bool culled, std::vector<SubmeshLod>& runs) const {
+
+		const Submesh& source = this->submeshes[submesh];
+		runs.clear();
+
+		if (lod > 0 && !source.lods.empty()) {
+			runs.push_back(source.lods[std::min((size_t)lod, source.lods.size()) - 1]);
+			return;
+		}
+
+		// Simplified levels aren't split by shape, only the full level is culled range by range
+		if (!culled || source.ranges.empty()) {
+			SubmeshLod whole = { source.firstIndex, source.indexCount };
+			runs.push_back(whole);
+			return;
+		}
+
+		for (size_t r = 0; r < source.ranges.size(); r++) {
+
+			if (!this->rangeVisible[this->rangeStarts[submesh] + r]) {
+				continue;
+			}
+
+			const SubmeshRange& range = source.ranges[r];
+			if (!runs.empty() && runs.back().firstIndex + runs.back().indexCount == range.firstIndex) {
+				runs.back().indexCount += range.indexCount;
+			} else {
+				SubmeshLod run = { range.firstIndex, range.indexCount };
+				runs.push_back(run);
+			}
+		}
+	}
+
+	void Mesh::Submit(RenderQueue& queue, const gps::Shader& shader, unsigned lod, const glm::mat4& modelView, unsigned object) {
+
+		for (size_t s = 0; s < this->submeshes.size(); s++) {
+
+			const Submesh& submesh = this->submeshes[s];
+			if (!this->visible[s]) {
+				continue;
+			}
+
+			DrawItem item;
+			item.shader = &shader;
+			item.submesh = &submesh;
+			item.VAO = submesh.VAO ? submesh.VAO : this->buffers.VAO;
+			item.indexType = submesh.indexType;
+			item.firstIndex = submesh.firstIndex;
+			item.indexCount = submesh.indexCount;
+			item.baseVertex = submesh.baseVertex;
+			item.quantized = this->quantized;
+			item.object = object;
+
+			glm::vec3 center = (submesh.boundingBox.min + submesh.boundingBox.max) * 0.5f;
+			float depth = -(modelView * glm::vec4(center, 1.0f)).z;
+
+			if (submesh.indexType == GL_NONE) {
+				queue.push(RenderPassOpaque, item, depth);
+				continue;
+			}
+
+			this->getDrawRuns(s, lod, true, this->drawRuns);
+			for (size_t r = 0; r < this->drawRuns.size(); r++) {
+				item.firstIndex = this->drawRuns[r].firstIndex;
+				item.indexCount = this->drawRuns[r].indexCount;
+				queue.push(RenderPassOpaque, item, depth);
+			}
+		}
+	}
+
 	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh() {
+	void Mesh::setupMesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount) {
+
+		this->setupBuffers(vertexData, vertexCount * sizeof(Vertex), indexData, indexCount);
+		this->setupVertexAttributes();
+
+		GLState::bindVertexArray(0);
+	}
+
+	void Mesh::setupMesh(const QuantizedVertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount) {
+
+		this->setupBuffers(vertexData, vertexCount * sizeof(QuantizedVertex), indexData, indexCount);
+		this->setupVertexAttributes();
+
+		GLState::bindVertexArray(0);
+	}
+
+	// Points the attributes of the bound vertex array at the Vertex or QuantizedVertex layout
+	void Mesh::setupVertexAttributes() const {
+
+		if (!this->quantized) {
+			// Set the vertex attribute pointers
+			// Vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+			// Vertex Normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+			return;
+		}
+
+		// Vertex Positions, normalized to [0, 1] inside the submesh bounds
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (GLvoid*)offsetof(QuantizedVertex, Position));
+		// Octahedral Vertex Normals
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (GLvoid*)offsetof(QuantizedVertex, Normal));
+		// Vertex Texture Coords
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), (GLvoid*)offsetof(QuantizedVertex, TexCoords));
+	}
+
+	// Points the attributes of the bound vertex array at a source layout
+	void Mesh::setupAttributes(const std::vector<VertexAttribute>& attributes) const {
+
+		// Attributes missing from the layout read the default (0, 0, 0, 1)
+		for (size_t a = 0; a < attributes.size(); a++) {
+
+			const VertexAttribute& attribute = attributes[a];
+			glEnableVertexAttribArray(attribute.location);
+			glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized,
+				attribute.stride, (GLvoid*)attribute.offset);
+		}
+	}
+
+	// Gathers the submesh and shape range bounds for culling
+	void Mesh::setupCulling() {
+
+		for (size_t s = 0; s < this->submeshes.size(); s++) {
+
+			this->submeshBounds.add(this->submeshes[s].boundingBox);
+			this->rangeStarts.push_back(this->rangeBounds.count);
+			for (size_t r = 0; r < this->submeshes[s].ranges.size(); r++) {
+				this->rangeBounds.add(this->submeshes[s].ranges[r].boundingBox);
+			}
+		}
+		this->visible.assign(this->submeshBounds.centerX.size(), 1);
+		this->rangeVisible.assign(this->rangeBounds.centerX.size(), 1);
+	}
+
+	// Gives each submesh the key of its texture set and each texture its uniform slot
+	void Mesh::setupMaterials() {
+
+		for (size_t s = 0; s < this->submeshes.size(); s++) {
+
+			std::vector<Texture>& textures = this->submeshes[s].textures;
+			for (size_t t = 0; t < textures.size(); t++) {
+				textures[t].uniform = Shader::getTextureSlot(textures[t].type);
+			}
+			this->submeshes[s].materialKey = RenderQueue::getMaterialKey(textures);
+		}
+	}
+
+	// Creates the vertex array and fills the vertex and index buffers, leaving the vertex array bound
+	void Mesh::setupBuffers(const void* vertexData, size_t vertexBytes, const GLuint* indexData, size_t indexCount) {
 
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->buffers.VAO);
 		glGenBuffers(1, &this->buffers.VBO);
 		glGenBuffers(1, &this->buffers.EBO);
 
-		glBindVertexArray(this->buffers.VAO);
+		GLState::bindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indexData, GL_STATIC_DRAW);
+	}
 
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+	// Initializes the shared buffer and one vertex array per submesh layout
+	void Mesh::setupRawMesh(const unsigned char* bufferData, size_t bufferSize) {
+
+		this->buffers.VAO = 0;
+		this->buffers.EBO = 0;
+
+		// The same buffer serves as vertex and index buffer
+		glGenBuffers(1, &this->buffers.VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+		glBufferData(GL_ARRAY_BUFFER, bufferSize, bufferData, GL_STATIC_DRAW);
+
+		for (size_t s = 0; s < this->submeshes.size(); s++) {
+
+			Submesh& submesh = this->submeshes[s];
+
+			glGenVertexArrays(1, &submesh.VAO);
+			GLState::bindVertexArray(submesh.VAO);
+
+			if (submesh.indexType != GL_NONE) {
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.VBO);
+			}
+
+			this->setupAttributes(submesh.attributes);
+		}
 
-		glBindVertexArray(0);
+		GLState::bindVertexArray(0);
 	}
 }
@@ -12,6 +12,9 @@
 #include <glm/glm.hpp>
 
 #include "Shader.hpp"
+#include "GLState.hpp"
+#include "BoundingBox.h"
+#include "Frustum.hpp"
 
 #include <string>
 #include <vector>
@@ -26,12 +29,25 @@ namespace gps {
         glm::vec2 TexCoords;
     };
 
+    // Compact 16 byte layout of a Vertex
+    struct QuantizedVertex {
+
+        // unorm16 inside the bounding box of the submesh, w unused
+        GLushort Position[4];
+        // snorm16 octahedral encoding
+        GLshort Normal[2];
+        // half floats
+        GLushort TexCoords[2];
+    };
+
     struct Texture {
 
         GLuint id;
         //ambientTexture, diffuseTexture, specularTexture
         std::string type;
         std::string path;
+        //uniform slot of the type, set when the mesh is built
+        UniformSlot uniform = UniformSlotCount;
     };
 
     struct Material {
@@ -41,6 +57,65 @@ namespace gps {
         glm::vec3 specular;
     };
 
+    // Where one vertex attribute lives in the mesh buffer, for meshes that keep their source layout (glTF)
+    struct VertexAttribute {
+
+        GLuint location;
+        GLint size;
+        GLenum type;
+        GLboolean normalized;
+        GLsizei stride;
+        size_t offset;
+    };
+
+    // Index range of a simplified level of detail of a submesh
+    struct SubmeshLod {
+
+        GLuint firstIndex;
+        GLsizei indexCount;
+    };
+
+    // Index range of one .obj shape inside a submesh, culled on its own at the full level of detail
+    struct SubmeshRange {
+
+        GLuint firstIndex;
+        GLsizei indexCount;
+        BoundingBox boundingBox;
+    };
+
+    // Range of the model index buffer drawn with one material
+    struct Submesh {
+
+        GLuint firstIndex;
+        GLsizei indexCount;
+        GLint baseVertex;
+        int materialId;
+        std::vector<Texture> textures;
+        // Bounds of the submesh vertices in model space, used to dequantize positions
+        BoundingBox boundingBox;
+        // Moves the vertices into model space at draw time, the glTF node placing the submesh
+        glm::mat4 nodeMatrix = glm::mat4(1.0f);
+        // Coarser levels of detail, drawn from the same vertices
+        std::vector<SubmeshLod> lods;
+        // Shapes packed into the submesh, in index order and back to back, empty when there is only one
+        std::vector<SubmeshRange> ranges;
+        // GL_NONE draws indexCount vertices starting at baseVertex, without indices
+        GLenum indexType = GL_UNSIGNED_INT;
+        // Own attribute layout and vertex array, empty when the submesh uses the Vertex layout of the mesh
+        std::vector<VertexAttribute> attributes;
+        GLuint VAO = 0;
+        // Shared by the submeshes with the same textures, see RenderQueue::getMaterialKey
+        unsigned materialKey = 0;
+    };
+
+    // Size in bytes of one index of the given type
+    GLsizeiptr getIndexSize(GLenum indexType);
+
+    // Sets the nodeMatrix and nodeNormalMatrix uniforms at the given locations
+    void setNodeUniforms(GLint matrixLoc, GLint normalMatrixLoc, const glm::mat4& nodeMatrix);
+
+    class RenderQueue;
+
     struct Buffers {
         GLuint VAO;
         GLuint VBO;
@@ -52,20 +127,95 @@ namespace gps {
     public:
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
-        std::vector<Texture> textures;
+        std::vector<Submesh> submeshes;
 
-	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Submesh> submeshes);
+
+	    // Uploads the given buffers directly, without keeping a CPU copy (used by the mesh cache)
+	    Mesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, std::vector<Submesh> submeshes);
+
+	    // Uploads quantized vertices, decoded by the vertex shader with the submesh bounds
+	    Mesh(const QuantizedVertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount, std::vector<Submesh> submeshes);
+
+	    // Uploads a raw buffer holding both the vertex attributes and the indices of the submeshes,
+	    // each submesh reading it through its own attribute layout (used by glTF buffers)
+	    Mesh(const unsigned char* bufferData, size_t bufferSize, std::vector<Submesh> submeshes);
 
 	    Buffers getBuffers();
 
-	    void Draw(gps::Shader shader);
+	    // Deletes the buffers and vertex arrays of the mesh. Copies share them, so only the owner calls it.
+	    void Release();
+
+	    // Marks the submeshes and shape ranges whose bounds are outside the frustum, which Draw then skips.
+	    // Returns the number of culled boxes.
+	    size_t Cull(const Frustum& frustum);
+
+	    // Boxes Cull tests, submeshes and shape ranges
+	    size_t getCullBoxCount() const;
+
+	    // Marks every submesh visible again
+	    void ClearCulling();
+
+	    // Draws the given level of detail, submeshes with fewer levels use their coarsest one
+	    void Draw(const gps::Shader& shader, unsigned lod = 0);
+
+	    // Draws every submesh instanceCount times, through vertexArrays[s] for submesh s.
+	    // The culling of Cull doesn't apply, instances are culled by the caller.
+	    void DrawInstanced(const gps::Shader& shader, unsigned lod, const GLuint* vertexArrays, GLsizei instanceCount) const;
+
+	    // Vertex array Draw uses for the submesh
+	    GLuint getVertexArray(size_t submesh) const;
+
+	    // New vertex array reading the same vertices and indices as getVertexArray(submesh),
+	    // for callers that add their own attributes (instancing). The caller deletes it.
+	    GLuint CreateVertexArray(size_t submesh) const;
+
+	    // Queues the visible submeshes at the given level of detail instead of drawing them,
+	    // sorted by their distance from the camera
+	    void Submit(RenderQueue& queue, const gps::Shader& shader, unsigned lod, const glm::mat4& modelView, unsigned object);
 
     private:
         /*  Render data  */
         Buffers buffers;
+        bool quantized;
+        // Submesh bounds in model space and the result of the last Cull
+        BoxList submeshBounds;
+        std::vector<unsigned char> visible;
+        // The same for the shape ranges of every submesh, those of submesh s start at rangeStarts[s]
+        BoxList rangeBounds;
+        std::vector<unsigned char> rangeVisible;
+        std::vector<size_t> rangeStarts;
+        // Index runs of the submesh being drawn, reused between draws
+        mutable std::vector<SubmeshLod> drawRuns;
 
 	    // Initializes all the buffer objects/arrays
-	    void setupMesh();
+	    void setupMesh(const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount);
+
+	    void setupMesh(const QuantizedVertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount);
+
+	    // Points the attributes of the bound vertex array at the Vertex or QuantizedVertex layout
+	    void setupVertexAttributes() const;
+
+	    // Points the attributes of the bound vertex array at a source layout
+	    void setupAttributes(const std::vector<VertexAttribute>& attributes) const;
+
+	    void DrawSubmeshes(const gps::Shader& shader, unsigned lod, const GLuint* vertexArrays, GLsizei instanceCount) const;
+
+	    // Index runs to draw of a submesh at the level of detail: its visible shape ranges, merged
+	    // where they follow each other, or the whole level. Culling is ignored when culled is false.
+	    void getDrawRuns(size_t submesh, unsigned lod, bool culled, std::vector<SubmeshLod>& runs) const;
+
+	    // Gathers the submesh bounds for culling
+	    void setupCulling();
+
+	    // Gives each submesh the key of its texture set
+	    void setupMaterials();
+
+	    // Creates the vertex array and fills the vertex and index buffers, leaving the vertex array bound
+	    void setupBuffers(const void* vertexData, size_t vertexBytes, const GLuint* indexData, size_t indexCount);
+
+	    // Initializes the shared buffer and one vertex array per submesh layout
+	    void setupRawMesh(const unsigned char* bufferData, size_t bufferSize);
 
     };
 
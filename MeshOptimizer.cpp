@@ -0,0 +1,795 @@
+#include "MeshOptimizer.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+	// Cache size the Forsyth scores are tuned for
+	const unsigned forsythCacheSize = 32;
+	// Cache size of the FIFO simulation used by the analysis and the overdraw pass
+	const unsigned fifoCacheSize = 16;
+
+	float VertexCacheStats::getACMR() const {
+		return triangles ? (float)misses / triangles : 0.0f;
+	}
+
+	float VertexCacheStats::getATVR() const {
+		return vertices ? (float)misses / vertices : 0.0f;
+	}
+
+	VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+		triangles += other.triangles;
+		vertices += other.vertices;
+		misses += other.misses;
+		return *this;
+	}
+
+	// Pushes the vertices of a triangle through a FIFO cache kept as per-vertex insertion times,
+	// returns the number of misses
+	static unsigned updateFifoCache(const GLuint* triangle, std::vector<unsigned>& timestamps, unsigned& time, unsigned cacheSize) {
+
+		unsigned misses = 0;
+		for (int k = 0; k < 3; k++) {
+
+			GLuint v = triangle[k];
+			if (time - timestamps[v] > cacheSize) {
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize) {
+
+		VertexCacheStats stats;
+		stats.triangles = indexCount / 3;
+
+		std::vector<unsigned> timestamps(vertexCount, 0);
+		std::vector<bool> used(vertexCount, false);
+		unsigned time = cacheSize + 1;
+
+		for (size_t i = 0; i + 2 < indexCount; i += 3) {
+			stats.misses += updateFifoCache(indices + i, timestamps, time, cacheSize);
+		}
+
+		for (size_t i = 0; i < indexCount; i++) {
+			if (!used[indices[i]]) {
+				used[indices[i]] = true;
+				stats.vertices++;
+			}
+		}
+
+		return stats;
+	}
+
+	// Forsyth vertex score: recently used vertices and vertices with few remaining triangles win
+	static float getForsythScore(int cachePosition, unsigned valence) {
+
+		if (valence == 0) {
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			// The last triangle's vertices get a fixed score so its neighbours don't always win
+			if (cachePosition < 3) {
+				score = 0.75f;
+			} else {
+				score = std::pow(1.0f - (float)(cachePosition - 3) / (forsythCacheSize - 3), 1.5f);
+			}
+		}
+
+		score += 2.0f * std::pow((float)valence, -0.5f);
+		return score;
+	}
+
+	void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount) {
+
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// Triangles using each vertex; the first valence entries of a list are the ones not emitted yet
+		std::vector<unsigned> valence(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			valence[indices[i]]++;
+		}
+
+		std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) {
+			firstTriangle[v + 1] = firstTriangle[v] + valence[v];
+		}
+
+		std::vector<size_t> adjacency(triangleCount * 3);
+		std::vector<size_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			vertexScore[v] = getForsythScore(-1, valence[v]);
+		}
+
+		size_t best = 0;
+		float bestScore = -1.0f;
+		for (size_t t = 0; t < triangleCount; t++) {
+
+			const GLuint* triangle = indices + t * 3;
+			float score = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+			if (score > bestScore) {
+				bestScore = score;
+				best = t;
+			}
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<GLuint> result;
+		result.reserve(triangleCount * 3);
+
+		std::vector<GLuint> cache;
+		std::vector<GLuint> newCache;
+		size_t nextCandidate = 0;
+
+		while (result.size() < triangleCount * 3) {
+
+			// No cached vertex has triangles left, restart from the first triangle not emitted
+			if (best == (size_t)-1) {
+
+				while (emitted[nextCandidate]) {
+					nextCandidate++;
+				}
+				best = nextCandidate;
+			}
+
+			emitted[best] = true;
+			const GLuint* triangle = indices + best * 3;
+
+			newCache.clear();
+			for (int k = 0; k < 3; k++) {
+
+				GLuint v = triangle[k];
+				result.push_back(v);
+
+				size_t* triangles = &adjacency[firstTriangle[v]];
+				for (unsigned j = 0; j < valence[v]; j++) {
+					if (triangles[j] == best) {
+						std::swap(triangles[j], triangles[valence[v] - 1]);
+						break;
+					}
+				}
+				valence[v]--;
+
+				if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+					newCache.push_back(v);
+				}
+			}
+
+			for (size_t c = 0; c < cache.size(); c++) {
+				if (std::find(newCache.begin(), newCache.end(), cache[c]) == newCache.end()) {
+					newCache.push_back(cache[c]);
+				}
+			}
+
+			// Vertices pushed out of the cache lose their cache score
+			for (size_t c = forsythCacheSize; c < newCache.size(); c++) {
+
+				cachePosition[newCache[c]] = -1;
+				vertexScore[newCache[c]] = getForsythScore(-1, valence[newCache[c]]);
+			}
+			if (newCache.size() > forsythCacheSize) {
+				newCache.resize(forsythCacheSize);
+			}
+			cache.swap(newCache);
+
+			for (size_t c = 0; c < cache.size(); c++) {
+
+				cachePosition[cache[c]] = (int)c;
+				vertexScore[cache[c]] = getForsythScore((int)c, valence[cache[c]]);
+			}
+
+			// Only triangles touching the cache changed score, the next one is picked among them
+			best = (size_t)-1;
+			bestScore = -1.0f;
+			for (size_t c = 0; c < cache.size(); c++) {
+
+				GLuint v = cache[c];
+				const size_t* triangles = &adjacency[firstTriangle[v]];
+				for (unsigned j = 0; j < valence[v]; j++) {
+
+					const GLuint* candidate = indices + triangles[j] * 3;
+					float score = vertexScore[candidate[0]] + vertexScore[candidate[1]] + vertexScore[candidate[2]];
+
+					if (score > bestScore) {
+						bestScore = score;
+						best = triangles[j];
+					}
+				}
+			}
+		}
+
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	void OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold) {
+
+		size_t triangleCount = indexCount / 3;
+		if (threshold < 1.0f || triangleCount == 0) {
+			return;
+		}
+
+		std::vector<unsigned> timestamps(vertexCount, 0);
+		unsigned time = fifoCacheSize + 1;
+
+		// Hard boundaries: triangles missing on all three vertices, where the cache order restarts anyway
+		std::vector<size_t> hardClusters;
+		for (size_t t = 0; t < triangleCount; t++) {
+			if (updateFifoCache(indices + t * 3, timestamps, time, fifoCacheSize) == 3 || t == 0) {
+				hardClusters.push_back(t);
+			}
+		}
+		hardClusters.push_back(triangleCount);
+
+		// Soft boundaries: split each hard cluster as soon as its running ACMR drops under the
+		// threshold times the cluster average, so reordering costs at most that much
+		std::vector<size_t> clusters;
+		for (size_t h = 0; h + 1 < hardClusters.size(); h++) {
+
+			size_t start = hardClusters[h];
+			size_t end = hardClusters[h + 1];
+
+			time += fifoCacheSize + 1;
+			unsigned clusterMisses = 0;
+			for (size_t t = start; t < end; t++) {
+				clusterMisses += updateFifoCache(indices + t * 3, timestamps, time, fifoCacheSize);
+			}
+
+			size_t firstCluster = clusters.size();
+			clusters.push_back(start);
+
+			float clusterThreshold = threshold * clusterMisses / (end - start);
+			if (clusterThreshold >= 3.0f) {
+				continue;
+			}
+
+			time += fifoCacheSize + 1;
+			unsigned runningMisses = 0;
+			unsigned runningTriangles = 0;
+			for (size_t t = start; t < end; t++) {
+
+				runningMisses += updateFifoCache(indices + t * 3, timestamps, time, fifoCacheSize);
+				runningTriangles++;
+
+				if ((float)runningMisses / runningTriangles <= clusterThreshold) {
+
+					clusters.push_back(t + 1);
+					time += fifoCacheSize + 1;
+					runningMisses = 0;
+					runningTriangles = 0;
+				}
+			}
+
+			// A boundary at the very end is empty; a trailing cluster that never reached the
+			// target has frequent misses, so it goes back into the previous one
+			if (clusters.back() == end || clusters.size() - firstCluster > 1) {
+				clusters.pop_back();
+			}
+		}
+		clusters.push_back(triangleCount);
+
+		// Mesh centroid, the clusters facing away from it are drawn first
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		std::vector<glm::vec3> clusterCentroids(clusters.size() - 1, glm::vec3(0.0f));
+		std::vector<glm::vec3> clusterNormals(clusters.size() - 1, glm::vec3(0.0f));
+		std::vector<float> clusterAreas(clusters.size() - 1, 0.0f);
+
+		for (size_t c = 0; c + 1 < clusters.size(); c++) {
+
+			for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+
+				const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+				const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+				const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(normal);
+				glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+				clusterCentroids[c] += centroid * area;
+				clusterNormals[c] += normal;
+				clusterAreas[c] += area;
+				meshCentroid += centroid * area;
+				meshArea += area;
+			}
+		}
+
+		if (meshArea > 0.0f) {
+			meshCentroid /= meshArea;
+		}
+
+		std::vector<float> clusterKeys(clusters.size() - 1);
+		std::vector<size_t> order(clusters.size() - 1);
+		for (size_t c = 0; c < order.size(); c++) {
+
+			glm::vec3 centroid = clusterAreas[c] > 0.0f ? clusterCentroids[c] / clusterAreas[c] : meshCentroid;
+			float normalLength = glm::length(clusterNormals[c]);
+			glm::vec3 normal = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+
+			clusterKeys[c] = glm::dot(centroid - meshCentroid, normal);
+			order[c] = c;
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&clusterKeys](size_t a, size_t b) {
+			return clusterKeys[a] > clusterKeys[b];
+		});
+
+		std::vector<GLuint> result;
+		result.reserve(triangleCount * 3);
+		for (size_t o = 0; o < order.size(); o++) {
+			result.insert(result.end(), indices + clusters[order[o]] * 3, indices + clusters[order[o] + 1] * 3);
+		}
+
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	size_t OptimizeVertexFetch(Vertex* vertices, size_t vertexCount, GLuint* indices, size_t indexCount) {
+
+		const GLuint unused = (GLuint)-1;
+		std::vector<GLuint> remap(vertexCount, unused);
+		GLuint nextVertex = 0;
+
+		for (size_t i = 0; i < indexCount; i++) {
+
+			GLuint& v = remap[indices[i]];
+			if (v == unused) {
+				v = nextVertex++;
+			}
+			indices[i] = v;
+		}
+
+		size_t usedCount = nextVertex;
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (remap[v] == unused) {
+				remap[v] = nextVertex++;
+			}
+		}
+
+		std::vector<Vertex> reordered(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			reordered[remap[v]] = vertices[v];
+		}
+		std::copy(reordered.begin(), reordered.end(), vertices);
+
+		return usedCount;
+	}
+
+	// Symmetric 4x4 error quadric of Garland and Heckbert, stored as its 10 distinct terms
+	struct Quadric {
+
+		float a00, a11, a22, a01, a02, a12;
+		float b0, b1, b2;
+		float c;
+	};
+
+	static void addQuadric(Quadric& q, const Quadric& other) {
+
+		q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+		q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+		q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+		q.c += other.c;
+	}
+
+	// Squared distance to the plane n.p + d = 0, weighted
+	static Quadric getPlaneQuadric(const glm::vec3& n, float d, float weight) {
+
+		Quadric q;
+		q.a00 = weight * n.x * n.x; q.a11 = weight * n.y * n.y; q.a22 = weight * n.z * n.z;
+		q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z; q.a12 = weight * n.y * n.z;
+		q.b0 = weight * n.x * d; q.b1 = weight * n.y * d; q.b2 = weight * n.z * d;
+		q.c = weight * d * d;
+		return q;
+	}
+
+	static float getQuadricError(const Quadric& q, const glm::vec3& p) {
+
+		float rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+		float ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+		float rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+		float error = rx * p.x + ry * p.y + rz * p.z + 2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+		return std::abs(error);
+	}
+
+	// Hashes a position by its exact bits, to find the vertices split along seams
+	struct PositionHash {
+		size_t operator()(const glm::vec3& p) const {
+			uint32_t bits[3];
+			std::memcpy(bits, &p.x, sizeof(float));
+			std::memcpy(bits + 1, &p.y, sizeof(float));
+			std::memcpy(bits + 2, &p.z, sizeof(float));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	// A collapse of every vertex at one position onto a neighbouring position
+	struct EdgeCollapse {
+
+		GLuint from;
+		GLuint to;
+		float error;
+	};
+
+	size_t SimplifyMesh(GLuint* destination, const GLuint* indices, size_t indexCount,
+		const Vertex* vertices, size_t vertexCount, size_t targetIndexCount) {
+
+		std::vector<GLuint> result(indices, indices + indexCount / 3 * 3);
+
+		// Vertices split along seams (same position, different normal or texture coordinates) move
+		// together, so the simplification works on positions
+		std::unordered_map<glm::vec3, GLuint, PositionHash> positionIds;
+		std::vector<GLuint> positionOf(vertexCount);
+		std::vector<std::vector<GLuint>> positionVertices;
+		for (size_t v = 0; v < vertexCount; v++) {
+
+			std::pair<std::unordered_map<glm::vec3, GLuint, PositionHash>::iterator, bool> inserted =
+				positionIds.insert(std::make_pair(vertices[v].Position, (GLuint)positionVertices.size()));
+			if (inserted.second) {
+				positionVertices.push_back(std::vector<GLuint>());
+			}
+			positionOf[v] = inserted.first->second;
+			positionVertices[positionOf[v]].push_back((GLuint)v);
+		}
+		size_t positionCount = positionVertices.size();
+
+		// Positions on open or non-manifold edges stay put, keeping the outline of the mesh
+		std::vector<bool> locked(positionCount, false);
+		std::unordered_map<uint64_t, unsigned> edgeUses;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int k = 0; k < 3; k++) {
+
+				GLuint a = positionOf[result[i + k]];
+				GLuint b = positionOf[result[i + (k + 1) % 3]];
+				edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+			}
+		}
+		for (std::unordered_map<uint64_t, unsigned>::const_iterator edge = edgeUses.begin(); edge != edgeUses.end(); ++edge) {
+			if (edge->second != 2) {
+				locked[(GLuint)(edge->first >> 32)] = true;
+				locked[(GLuint)(edge->first & 0xffffffffu)] = true;
+			}
+		}
+
+		// Area weighted quadrics of the planes around each position
+		Quadric zero;
+		std::memset(&zero, 0, sizeof(zero));
+		std::vector<Quadric> quadrics(positionCount, zero);
+		for (size_t i = 0; i < result.size(); i += 3) {
+
+			const glm::vec3& p0 = vertices[result[i + 0]].Position;
+			const glm::vec3& p1 = vertices[result[i + 1]].Position;
+			const glm::vec3& p2 = vertices[result[i + 2]].Position;
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			if (area == 0.0f) {
+				continue;
+			}
+			normal /= area;
+
+			Quadric plane = getPlaneQuadric(normal, -glm::dot(normal, p0), area * 0.5f);
+			for (int k = 0; k < 3; k++) {
+				addQuadric(quadrics[positionOf[result[i + k]]], plane);
+			}
+		}
+
+		std::vector<GLuint> collapseTarget(vertexCount);
+		std::vector<bool> touched(positionCount);
+		std::vector<EdgeCollapse> collapses;
+		std::vector<std::vector<size_t>> vertexTriangles(vertexCount);
+		std::vector<GLuint> targets;
+
+		// Each pass collapses the cheapest edges that don't touch each other, then cleans up
+		while (result.size() > targetIndexCount) {
+
+			for (size_t v = 0; v < vertexCount; v++) {
+				vertexTriangles[v].clear();
+			}
+			for (size_t i = 0; i < result.size(); i += 3) {
+				for (int k = 0; k < 3; k++) {
+					vertexTriangles[result[i + k]].push_back(i / 3);
+				}
+			}
+
+			collapses.clear();
+			for (size_t i = 0; i < result.size(); i += 3) {
+				for (int k = 0; k < 3; k++) {
+
+					GLuint a = positionOf[result[i + k]];
+					GLuint b = positionOf[result[i + (k + 1) % 3]];
+					if (a == b) {
+						continue;
+					}
+
+					Quadric merged = quadrics[a];
+					addQuadric(merged, quadrics[b]);
+
+					if (!locked[a]) {
+						EdgeCollapse collapse = { a, b, getQuadricError(merged, vertices[positionVertices[b][0]].Position) };
+						collapses.push_back(collapse);
+					}
+					if (!locked[b]) {
+						EdgeCollapse collapse = { b, a, getQuadricError(merged, vertices[positionVertices[a][0]].Position) };
+						collapses.push_back(collapse);
+					}
+				}
+			}
+
+			std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& a, const EdgeCollapse& b) {
+				return a.error < b.error;
+			});
+
+			for (size_t v = 0; v < vertexCount; v++) {
+				collapseTarget[v] = (GLuint)v;
+			}
+			std::fill(touched.begin(), touched.end(), false);
+
+			size_t triangleCount = result.size() / 3;
+			size_t targetTriangles = targetIndexCount / 3;
+			size_t collapsed = 0;
+
+			for (size_t c = 0; c < collapses.size() && triangleCount > targetTriangles; c++) {
+
+				const EdgeCollapse& collapse = collapses[c];
+				if (touched[collapse.from] || touched[collapse.to]) {
+					continue;
+				}
+
+				const std::vector<GLuint>& moving = positionVertices[collapse.from];
+				const glm::vec3& destinationPosition = vertices[positionVertices[collapse.to][0]].Position;
+
+				// Every vertex at the moving position needs a neighbour at the destination to take
+				// its attributes from, otherwise the collapse would tear a seam open
+				bool valid = true;
+				size_t removed = 0;
+				targets.clear();
+				for (size_t m = 0; m < moving.size() && valid; m++) {
+
+					// Vertices no triangle uses anymore have nothing to carry over
+					const std::vector<size_t>& around = vertexTriangles[moving[m]];
+					GLuint target = around.empty() ? moving[m] : (GLuint)-1;
+					for (size_t t = 0; t < around.size(); t++) {
+
+						const GLuint* triangle = &result[around[t] * 3];
+						bool collapsing = false;
+						for (int k = 0; k < 3; k++) {
+							if (positionOf[triangle[k]] == collapse.to) {
+								target = triangle[k];
+								collapsing = true;
+							}
+						}
+
+						if (collapsing) {
+							removed++;
+							continue;
+						}
+
+						// Reject collapses that flip a triangle around the moving position
+						glm::vec3 before[3];
+						glm::vec3 after[3];
+						for (int k = 0; k < 3; k++) {
+							before[k] = vertices[triangle[k]].Position;
+							after[k] = triangle[k] == moving[m] ? destinationPosition : before[k];
+						}
+
+						glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+						glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+						if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+							valid = false;
+							break;
+						}
+					}
+
+					valid = valid && target != (GLuint)-1;
+					targets.push_back(target);
+				}
+
+				if (!valid) {
+					continue;
+				}
+
+				for (size_t m = 0; m < moving.size(); m++) {
+					collapseTarget[moving[m]] = targets[m];
+				}
+				addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+
+				// The neighbourhood changed, its flip checks are out of date until the next pass
+				for (size_t m = 0; m < moving.size(); m++) {
+
+					const std::vector<size_t>& around = vertexTriangles[moving[m]];
+					for (size_t t = 0; t < around.size(); t++) {
+						for (int k = 0; k < 3; k++) {
+							touched[positionOf[result[around[t] * 3 + k]]] = true;
+						}
+					}
+				}
+
+				triangleCount -= std::min(triangleCount, removed);
+				collapsed++;
+			}
+
+			if (collapsed == 0) {
+				break;
+			}
+
+			// Apply the collapses and drop the triangles that became degenerate
+			size_t write = 0;
+			for (size_t i = 0; i < result.size(); i += 3) {
+
+				GLuint a = collapseTarget[result[i + 0]];
+				GLuint b = collapseTarget[result[i + 1]];
+				GLuint c = collapseTarget[result[i + 2]];
+
+				if (positionOf[a] != positionOf[b] && positionOf[b] != positionOf[c] && positionOf[a] != positionOf[c]) {
+					result[write++] = a;
+					result[write++] = b;
+					result[write++] = c;
+				}
+			}
+			result.resize(write);
+
+			// Vertices moved away no longer stand for their old position
+			for (size_t p = 0; p < positionCount; p++) {
+
+				std::vector<GLuint>& group = positionVertices[p];
+				group.erase(std::remove_if(group.begin(), group.end(), [&collapseTarget](GLuint v) {
+					return collapseTarget[v] != v;
+				}), group.end());
+			}
+		}
+
+		std::copy(result.begin(), result.end(), destination);
+		return result.size();
+	}
+
+	// Each submesh of a packed mesh owns the vertices from its base vertex up to the next submesh's
+	static size_t getSubmeshVertexCount(const std::vector<Submesh>& submeshes, size_t s, size_t vertexCount) {
+
+		size_t vertexEnd = s + 1 < submeshes.size() ? submeshes[s + 1].baseVertex : vertexCount;
+		return vertexEnd - submeshes[s].baseVertex;
+	}
+
+	// Octahedral encoding: the unit sphere folded onto the |x| + |y| <= 1 square
+	static glm::vec2 encodeOctahedral(glm::vec3 normal) {
+
+		float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (length == 0.0f) {
+			return glm::vec2(0.0f);
+		}
+
+		normal /= length;
+		glm::vec2 encoded(normal.x, normal.y);
+		if (normal.z < 0.0f) {
+			encoded.x = (1.0f - std::abs(normal.y)) * (normal.x >= 0.0f ? 1.0f : -1.0f);
+			encoded.y = (1.0f - std::abs(normal.x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return encoded;
+	}
+
+	void QuantizeVertices(const Vertex* vertices, size_t vertexCount, const std::vector<Submesh>& submeshes,
+		std::vector<QuantizedVertex>& quantized) {
+
+		quantized.resize(vertexCount);
+
+		for (size_t s = 0; s < submeshes.size(); s++) {
+
+			const BoundingBox& bounds = submeshes[s].boundingBox;
+			glm::vec3 extent = bounds.max - bounds.min;
+
+			size_t first = submeshes[s].baseVertex;
+			size_t count = getSubmeshVertexCount(submeshes, s, vertexCount);
+
+			for (size_t v = first; v < first + count; v++) {
+
+				const Vertex& vertex = vertices[v];
+				QuantizedVertex& packed = quantized[v];
+
+				for (int i = 0; i < 3; i++) {
+					// Flat submeshes have no extent along one axis
+					float position = extent[i] > 0.0f ? (vertex.Position[i] - bounds.min[i]) / extent[i] : 0.0f;
+					packed.Position[i] = glm::packUnorm1x16(position);
+				}
+				packed.Position[3] = 0;
+
+				glm::vec2 normal = encodeOctahedral(vertex.Normal);
+				packed.Normal[0] = (GLshort)glm::packSnorm1x16(normal.x);
+				packed.Normal[1] = (GLshort)glm::packSnorm1x16(normal.y);
+
+				packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+				packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+			}
+		}
+	}
+
+	void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+		const std::vector<Submesh>& submeshes, float overdrawThreshold) {
+
+		for (size_t s = 0; s < submeshes.size(); s++) {
+
+			const Submesh& submesh = submeshes[s];
+			if (submesh.indexType != GL_UNSIGNED_INT || submesh.indexCount == 0) {
+				continue;
+			}
+
+			size_t vertexCount = getSubmeshVertexCount(submeshes, s, vertices.size());
+			Vertex* submeshVertices = vertices.data() + submesh.baseVertex;
+			GLuint* submeshIndices = indices.data() + submesh.firstIndex;
+
+			// Triangles stay inside their shape range, so the ranges can still be culled on their own
+			if (submesh.ranges.empty()) {
+				OptimizeVertexCache(submeshIndices, submesh.indexCount, vertexCount);
+				OptimizeOverdraw(submeshIndices, submesh.indexCount, submeshVertices, vertexCount, overdrawThreshold);
+			}
+			for (size_t r = 0; r < submesh.ranges.size(); r++) {
+				GLuint* rangeIndices = indices.data() + submesh.ranges[r].firstIndex;
+				OptimizeVertexCache(rangeIndices, submesh.ranges[r].indexCount, vertexCount);
+				OptimizeOverdraw(rangeIndices, submesh.ranges[r].indexCount, submeshVertices, vertexCount, overdrawThreshold);
+			}
+			OptimizeVertexFetch(submeshVertices, vertexCount, submeshIndices, submesh.indexCount);
+		}
+	}
+
+	void GenerateLods(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+		std::vector<Submesh>& submeshes, const float* ratios, size_t levelCount) {
+
+		for (size_t s = 0; s < submeshes.size(); s++) {
+
+			Submesh& submesh = submeshes[s];
+			submesh.lods.clear();
+			if (submesh.indexType != GL_UNSIGNED_INT || submesh.indexCount == 0) {
+				continue;
+			}
+
+			size_t vertexCount = getSubmeshVertexCount(submeshes, s, vertices.size());
+			const Vertex* submeshVertices = vertices.data() + submesh.baseVertex;
+
+			// Each level is simplified from the previous one
+			std::vector<GLuint> previous(indices.begin() + submesh.firstIndex,
+				indices.begin() + submesh.firstIndex + submesh.indexCount);
+			std::vector<GLuint> level;
+
+			for (size_t l = 0; l < levelCount; l++) {
+
+				size_t target = (size_t)(submesh.indexCount * ratios[l]) / 3 * 3;
+
+				level.resize(previous.size());
+				size_t levelIndexCount = SimplifyMesh(level.data(), previous.data(), previous.size(),
+					submeshVertices, vertexCount, target);
+				level.resize(levelIndexCount);
+
+				// Nothing left to collapse, coarser levels would be the same
+				if (levelIndexCount == 0 || levelIndexCount >= previous.size()) {
+					break;
+				}
+
+				OptimizeVertexCache(level.data(), level.size(), vertexCount);
+
+				SubmeshLod lod;
+				lod.firstIndex = (GLuint)indices.size();
+				lod.indexCount = (GLsizei)level.size();
+				submesh.lods.push_back(lod);
+
+				indices.insert(indices.end(), level.begin(), level.end());
+				previous.swap(level);
+			}
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Post-transform vertex cache behaviour of an index buffer, simulated with a FIFO cache
+    struct VertexCacheStats {
+
+        size_t triangles = 0;
+        size_t vertices = 0;
+        size_t misses = 0;
+
+        // Average cache miss ratio, transformed vertices per triangle (0.5 is ideal, 3 is worst)
+        float getACMR() const;
+        // Average transform to vertex ratio, transformed vertices per unique vertex (1 is ideal)
+        float getATVR() const;
+
+        VertexCacheStats& operator+=(const VertexCacheStats& other);
+    };
+
+    // Simulates a FIFO post-transform cache of cacheSize entries over a triangle list
+    VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16);
+
+    // Reorders triangles for vertex cache locality (Forsyth's linear-speed algorithm)
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount);
+
+    // Reorders the clusters of a cache-optimized triangle list so outward facing triangles
+    // are drawn first, as long as the ACMR grows by less than threshold (1.05 = 5%)
+    void OptimizeOverdraw(GLuint* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold);
+
+    // Renumbers vertices in the order the indices first use them, for fetch locality.
+    // Returns the number of vertices used; unused ones are moved past it.
+    size_t OptimizeVertexFetch(Vertex* vertices, size_t vertexCount, GLuint* indices, size_t indexCount);
+
+    // Quadric error edge collapse towards targetIndexCount, moving vertices onto existing ones
+    // (seam and border vertices stay put). Writes the new triangle list to destination,
+    // which must hold indexCount indices, and returns its size.
+    size_t SimplifyMesh(GLuint* destination, const GLuint* indices, size_t indexCount,
+        const Vertex* vertices, size_t vertexCount, size_t targetIndexCount);
+
+    // Runs the three passes above on each submesh range of a packed mesh.
+    // An overdrawThreshold below 1 skips the overdraw pass.
+    void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+        const std::vector<Submesh>& submeshes, float overdrawThreshold);
+
+    // Packs the vertices into the 16 byte layout, positions relative to the bounding box of their submesh
+    void QuantizeVertices(const Vertex* vertices, size_t vertexCount, const std::vector<Submesh>& submeshes,
+        std::vector<QuantizedVertex>& quantized);
+
+    // Appends levelCount simplified levels of each submesh to the index buffer, level l aiming
+    // at ratios[l] of the full index count. Submeshes that can't be simplified get fewer levels.
+    void GenerateLods(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+        std::vector<Submesh>& submeshes, const float* ratios, size_t levelCount);
+
+}
+
+#endif /* MeshOptimizer_hpp */
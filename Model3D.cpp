@@ -1,43 +1,643 @@
 #include "Model3D.hpp"
+#include "MeshOptimizer.hpp"
+#include "ObjLoader.hpp"
+#include "ThreadPool.hpp"
+#include "Profiler.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#include "tiny_gltf.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 namespace gps {
 
+	// Binary mesh cache layout (native endianness):
+	//   MeshCacheHeader
+	//   per source file besides the .obj (its .mtl libraries): DependencyCacheRecord, path
+	//   per mesh: MeshCacheRecord,
+	//             per submesh: SubmeshCacheRecord, level of detail ranges (SubmeshLodCacheRecord),
+	//                          shape ranges (SubmeshRangeCacheRecord),
+	//                          textures (length-prefixed type and path strings),
+	//             vertices, indices
+	// Every block is padded to 4 bytes so vertex and index data can be used straight from the mapping.
+	const char meshCacheMagic[4] = { 'P', 'G', 'M', 'C' };
+	const uint32_t meshCacheVersion = 7;
+
+	struct MeshCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t meshCount;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t dependencyCount;
+		uint32_t reserved;
+	};
+
+	// Stamp of a file the cached data was read from, followed by its path (length-prefixed string)
+	struct DependencyCacheRecord {
+		uint64_t size;
+		int64_t time;
+	};
+
+	// Stamp of a file that did not exist, the cache stays valid while it still doesn't
+	const uint64_t missingFileSize = ~(uint64_t)0;
+
+	struct MeshCacheRecord {
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t submeshCount;
+		uint32_t reserved;
+	};
+
+	struct SubmeshCacheRecord {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int32_t baseVertex;
+		int32_t materialId;
+		uint32_t textureCount;
+		uint32_t lodCount;
+		uint32_t rangeCount;
+		uint32_t reserved;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	struct SubmeshLodCacheRecord {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	struct SubmeshRangeCacheRecord {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	static size_t alignCacheOffset(size_t offset) {
+		return (offset + 3) & ~(size_t)3;
+	}
+
+	// Checks that every mesh record of the cache, from offset on, lies inside the file
+	static bool isCacheComplete(const unsigned char* data, size_t size, size_t offset, uint32_t meshCount) {
+
+		for (uint32_t m = 0; m < meshCount; m++) {
+
+			if (offset + sizeof(MeshCacheRecord) > size) {
+				return false;
+			}
+
+			MeshCacheRecord record;
+			std::memcpy(&record, data + offset, sizeof(record));
+			offset += sizeof(MeshCacheRecord);
+
+			for (uint32_t sm = 0; sm < record.submeshCount; sm++) {
+
+				if (offset + sizeof(SubmeshCacheRecord) > size) {
+					return false;
+				}
+
+				SubmeshCacheRecord submeshRecord;
+				std::memcpy(&submeshRecord, data + offset, sizeof(submeshRecord));
+				offset += sizeof(SubmeshCacheRecord);
+
+				if ((uint64_t)submeshRecord.firstIndex + submeshRecord.indexCount > record.indexCount) {
+					return false;
+				}
+
+				for (uint32_t l = 0; l < submeshRecord.lodCount; l++) {
+
+					if (offset + sizeof(SubmeshLodCacheRecord) > size) {
+						return false;
+					}
+
+					SubmeshLodCacheRecord lodRecord;
+					std::memcpy(&lodRecord, data + offset, sizeof(lodRecord));
+					offset += sizeof(SubmeshLodCacheRecord);
+
+					if ((uint64_t)lodRecord.firstIndex + lodRecord.indexCount > record.indexCount) {
+						return false;
+					}
+				}
+
+				for (uint32_t r = 0; r < submeshRecord.rangeCount; r++) {
+
+					if (offset + sizeof(SubmeshRangeCacheRecord) > size) {
+						return false;
+					}
+
+					SubmeshRangeCacheRecord rangeRecord;
+					std::memcpy(&rangeRecord, data + offset, sizeof(rangeRecord));
+					offset += sizeof(SubmeshRangeCacheRecord);
+
+					if ((uint64_t)rangeRecord.firstIndex + rangeRecord.indexCount > record.indexCount) {
+						return false;
+					}
+				}
+
+				for (uint32_t t = 0; t < submeshRecord.textureCount * 2; t++) {
+
+					uint32_t length;
+					if (offset + sizeof(length) > size) {
+						return false;
+					}
+					std::memcpy(&length, data + offset, sizeof(length));
+					offset = alignCacheOffset(offset + sizeof(length) + length);
+				}
+			}
+
+			offset += (size_t)record.vertexCount * sizeof(gps::Vertex) + (size_t)record.indexCount * sizeof(GLuint);
+			if (offset > size) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Size and modification time of the source file, used to invalidate stale caches
+	static bool getSourceStamp(const std::string& fileName, uint64_t& size, int64_t& time) {
+
+		struct stat fileStat;
+		if (stat(fileName.c_str(), &fileStat) != 0) {
+			return false;
+		}
+
+		size = (uint64_t)fileStat.st_size;
+		time = (int64_t)fileStat.st_mtime;
+		return true;
+	}
+
+	// Checks the dependency records that follow the header against the files, moving offset past them.
+	// False when a file changed, appeared or disappeared, or the records are cut short.
+	static bool areDependenciesCurrent(const unsigned char* data, size_t size, size_t& offset, uint32_t dependencyCount) {
+
+		for (uint32_t d = 0; d < dependencyCount; d++) {
+
+			DependencyCacheRecord record;
+			uint32_t length;
+			if (offset + sizeof(record) + sizeof(length) > size) {
+				return false;
+			}
+			std::memcpy(&record, data + offset, sizeof(record));
+			std::memcpy(&length, data + offset + sizeof(record), sizeof(length));
+			offset += sizeof(record) + sizeof(length);
+			if (offset + length > size) {
+				return false;
+			}
+
+			std::string path((const char*)data + offset, length);
+			offset = alignCacheOffset(offset + length);
+
+			uint64_t fileSize = missingFileSize;
+			int64_t fileTime = 0;
+			getSourceStamp(path, fileSize, fileTime);
+			if (fileSize != record.size || fileTime != record.time) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Material libraries named by the mtllib lines of an .obj file, resolved against basePath as tinyobj does
+	static std::vector<std::string> getMaterialLibraries(const std::string& fileName, const std::string& basePath) {
+
+		std::vector<std::string> libraries;
+		std::ifstream file(fileName.c_str());
+		std::string line;
+		while (std::getline(file, line)) {
+
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 6, "mtllib") != 0) {
+				continue;
+			}
+
+			std::istringstream names(line.substr(start + 6));
+			std::string name;
+			while (names >> name) {
+				libraries.push_back(basePath + name);
+			}
+		}
+		return libraries;
+	}
+
+	// Hashes the (vertex, normal, texcoord) index triple of an .obj face corner
+	struct ObjIndexHash {
+		size_t operator()(const tinyobj::index_t& idx) const {
+			size_t h = std::hash<int>()(idx.vertex_index);
+			h ^= std::hash<int>()(idx.normal_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<int>()(idx.texcoord_index) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	struct ObjIndexEqual {
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
+			return a.vertex_index == b.vertex_index &&
+				a.normal_index == b.normal_index &&
+				a.texcoord_index == b.texcoord_index;
+		}
+	};
+
+	// Lowercase extension of a file name, without the dot
+	static std::string getExtension(const std::string& fileName) {
+
+		std::string extension = fileName.substr(fileName.find_last_of('.') + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension;
+	}
+
+	// Simplification targets of the levels of detail, relative to the full mesh
+	const float lodRatios[] = { 0.5f, 0.25f, 0.125f };
+	const size_t lodLevelCount = sizeof(lodRatios) / sizeof(lodRatios[0]);
+	// Projected size (fraction of the viewport height) under which level i + 1 replaces level i
+	const float lodScreenSizes[lodLevelCount] = { 0.25f, 0.1f, 0.04f };
+
+	static CullingStats cullingStats = { 0, 0 };
+
+	// Models whose data is decoded and waiting for ProcessUploads, in completion order
+	static std::mutex uploadQueueMutex;
+	static std::deque<Model3D*> uploadQueue;
+
+	// Whole-model jobs run on their own workers: they wait on the chunk tasks
+	// LoadObjParallel puts on the shared pool
+	static ThreadPool& getLoaderPool() {
+		static ThreadPool loaderPool(2);
+		return loaderPool;
+	}
+
 	void Model3D::LoadModel(std::string fileName) {
 
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
 		std::cout << basePath << '\n';
-		boundingBox = BoundingBox(glm::vec3(std::numeric_limits<float>::max()),
-			glm::vec3(std::numeric_limits<float>::lowest()));
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)	{
-		boundingBox = BoundingBox(glm::vec3(std::numeric_limits<float>::max()),
+
+		pendingData.reset(new ModelData());
+		LoadModelData(fileName, basePath, *pendingData);
+
+		// A texture another model is loading arrives with that model's upload
+		size_t unlimited = (size_t)-1;
+		while (!UploadStep(unlimited)) {
+			unlimited = (size_t)-1;
+			ProcessUploads(unlimited);
+			std::this_thread::yield();
+		}
+	}
+
+	void Model3D::LoadModelAsync(std::string fileName, std::string basePath, std::function<void()> onReady) {
+
+		this->onReady = onReady;
+		pendingData.reset(new ModelData());
+
+		loading = getLoaderPool().submit([this, fileName, basePath]() {
+
+			LoadModelData(fileName, basePath, *pendingData);
+
+			std::lock_guard<std::mutex> lock(uploadQueueMutex);
+			uploadQueue.push_back(this);
+		});
+	}
+
+	void Model3D::ProcessUploads(size_t byteBudget) {
+
+		if (byteBudget == 0) {
+			byteBudget = 1;
+		}
+
+		// Models waiting for a texture of a model behind them are skipped, not waited for
+		size_t next = 0;
+		while (byteBudget > 0) {
+
+			Model3D* model;
+			{
+				std::lock_guard<std::mutex> lock(uploadQueueMutex);
+				if (next >= uploadQueue.size()) {
+					return;
+				}
+				model = uploadQueue[next];
+			}
+
+			if (!model->UploadStep(byteBudget)) {
+				next++;
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(uploadQueueMutex);
+				uploadQueue.erase(uploadQueue.begin() + next);
+			}
+
+			if (model->onReady) {
+				model->onReady();
+			}
+		}
+	}
+
+	bool Model3D::isReady() const {
+		return ready;
+	}
+
+	// Reads the model (from its cache when valid) and decodes its textures, without touching GL
+	void Model3D::LoadModelData(std::string fileName, std::string basePath, ModelData& data) {
+
+		data.boundingBox = BoundingBox(glm::vec3(std::numeric_limits<float>::max()),
 			glm::vec3(std::numeric_limits<float>::lowest()));
-		ReadOBJ(fileName, basePath);
+
+		std::string extension = getExtension(fileName);
+		if (extension == "gltf" || extension == "glb") {
+
+			// glTF buffers are already binary, there is nothing to cache
+			ReadGLTF(fileName, data);
+		} else {
+
+			std::string cacheFileName = fileName + ".cache";
+			if (!ReadCache(cacheFileName, fileName, data)) {
+
+				ReadOBJ(fileName, basePath, data);
+				OptimizeMeshes(data);
+				GenerateLods(data);
+				WriteCache(cacheFileName, fileName, data);
+			}
+		}
+
+		if (quantizeVertices) {
+
+			for (size_t m = 0; m < data.meshes.size(); m++) {
+
+				MeshData& mesh = data.meshes[m];
+				if (!mesh.buffer.empty()) {
+					continue;
+				}
+
+				const gps::Vertex* vertexData = mesh.vertexData ? mesh.vertexData : mesh.vertices.data();
+				size_t vertexCount = mesh.vertexData ? mesh.vertexCount : mesh.vertices.size();
+				QuantizeVertices(vertexData, vertexCount, mesh.submeshes, mesh.quantizedVertices);
+			}
+		}
+
+		DecodeTextures(data);
+	}
+
+	// Uploads pending textures and meshes until the budget runs out, returns true when done
+	bool Model3D::UploadStep(size_t& byteBudget) {
+
+		ModelData& data = *pendingData;
+
+		while (data.uploadedImages < data.images.size()) {
+
+			if (byteBudget == 0) {
+				return false;
+			}
+
+			TextureImage& image = data.images[data.uploadedImages++];
+
+			textures.push_back(TextureManager::acquire(image));
+
+			size_t imageSize = (size_t)image.width * image.height * 4;
+			byteBudget -= std::min(byteBudget, imageSize);
+
+			FreeImage(image);
+		}
+
+		while (!data.awaitedTextures.empty()) {
+
+			bool decode;
+			TextureHandle handle = TextureManager::acquire(data.awaitedTextures.back(), decode);
+			if (!handle && !decode) {
+				return false;
+			}
+
+			if (!handle) {
+				// The model decoding it went away first, this one loads it after all
+				TextureImage image = DecodeTexture(data.awaitedTextures.back());
+				handle = TextureManager::acquire(image);
+				FreeImage(image);
+			}
+			data.sharedTextures.push_back(handle);
+			data.awaitedTextures.pop_back();
+		}
+
+		while (data.uploadedMeshes < data.meshes.size()) {
+
+			if (byteBudget == 0) {
+				return false;
+			}
+
+			MeshData& mesh = data.meshes[data.uploadedMeshes++];
+
+			for (size_t sm = 0; sm < mesh.submeshes.size(); sm++) {
+
+				std::vector<gps::Texture>& textures = mesh.submeshes[sm].textures;
+				for (size_t t = 0; t < textures.size(); t++) {
+					textures[t] = LoadTexture(textures[t].path, textures[t].type);
+				}
+			}
+
+			if (!mesh.buffer.empty()) {
+
+				meshes.push_back(gps::Mesh(mesh.buffer.data() + mesh.bufferOffset, mesh.bufferSize, mesh.submeshes));
+				byteBudget -= std::min(byteBudget, mesh.bufferSize);
+				continue;
+			}
+
+			const gps::Vertex* vertexData = mesh.vertexData ? mesh.vertexData : mesh.vertices.data();
+			size_t vertexCount = mesh.vertexData ? mesh.vertexCount : mesh.vertices.size();
+			const GLuint* indexData = mesh.indexData ? mesh.indexData : mesh.indices.data();
+			size_t indexCount = mesh.indexData ? mesh.indexCount : mesh.indices.size();
+
+			size_t meshSize;
+			if (!mesh.quantizedVertices.empty()) {
+
+				meshes.push_back(gps::Mesh(mesh.quantizedVertices.data(), vertexCount, indexData, indexCount, mesh.submeshes));
+				meshSize = vertexCount * sizeof(gps::QuantizedVertex) + indexCount * sizeof(GLuint);
+			} else {
+
+				meshes.push_back(gps::Mesh(vertexData, vertexCount, indexData, indexCount, mesh.submeshes));
+				meshSize = vertexCount * sizeof(gps::Vertex) + indexCount * sizeof(GLuint);
+			}
+
+			byteBudget -= std::min(byteBudget, meshSize);
+		}
+
+		textures.insert(textures.end(), data.sharedTextures.begin(), data.sharedTextures.end());
+		data.sharedTextures.clear();
+
+		boundingBox = data.boundingBox;
+		// Also releases the cache file mapping
+		pendingData.reset();
+		ready = true;
+
+		return true;
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram) {
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+	void Model3D::Draw(const gps::Shader& shaderProgram) {
+		ProfileScope zone("Model3D::Draw");
+		GpuProfileScope gpuZone("Model3D::Draw");
+		for (int i = 0; i < meshes.size(); i++) {
+			meshes[i].ClearCulling();
+			meshes[i].Draw(shaderProgram, lodLevel);
+		}
+	}
+
+	// Draw the visible submeshes of the model at the level of detail matching its size on screen
+	void Model3D::Draw(const gps::Shader& shaderProgram, const glm::mat4& modelView, const glm::mat4& projection) {
+
+		ProfileScope zone("Model3D::Draw");
+		if (!Cull(modelView, projection)) {
+			return;
+		}
+
+		GpuProfileScope gpuZone("Model3D::Draw");
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshes[i].Draw(shaderProgram, lodLevel);
+		}
+	}
+
+	void Model3D::Submit(RenderQueue& queue, const gps::Shader& shaderProgram, const glm::mat4& modelView,
+		const glm::mat4& projection, unsigned object) {
+
+		ProfileScope zone("Model3D::Submit");
+		if (!Cull(modelView, projection)) {
+			return;
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshes[i].Submit(queue, shaderProgram, lodLevel, modelView, object);
+		}
+	}
+
+	// Culls the submeshes and picks the level of detail, returns false when the whole model is outside
+	bool Model3D::Cull(const glm::mat4& modelView, const glm::mat4& projection) {
+
+		// Planes in model space, so the boxes are tested as they are stored
+		Frustum frustum(projection * modelView);
+
+		cullingStats.tested++;
+		if (!frustum.isVisible(boundingBox)) {
+			cullingStats.culled++;
+			return false;
+		}
+
+		UpdateLodLevel(modelView, projection);
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			cullingStats.tested += meshes[i].getCullBoxCount();
+			cullingStats.culled += meshes[i].Cull(frustum);
+		}
+		return true;
+	}
+
+	CullingStats Model3D::getCullingStats() {
+		return cullingStats;
+	}
+
+	void Model3D::resetCullingStats() {
+		cullingStats.tested = 0;
+		cullingStats.culled = 0;
+	}
+
+	void Model3D::setLodHysteresis(float hysteresis) {
+		lodHysteresis = hysteresis;
+	}
+
+	unsigned Model3D::getLodLevel() const {
+		return lodLevel;
+	}
+
+	float Model3D::getScreenSize(const glm::mat4& modelView, const glm::mat4& projection) const {
+
+		glm::vec3 center = (boundingBox.min + boundingBox.max) * 0.5f;
+		float radius = glm::length(boundingBox.max - boundingBox.min) * 0.5f;
+
+		glm::vec3 viewCenter = glm::vec3(modelView * glm::vec4(center, 1.0f));
+		float scale = std::max(glm::length(glm::vec3(modelView[0])),
+			std::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+		float viewRadius = radius * scale;
+		float distance = -viewCenter.z;
+
+		// Sphere diameter over the viewport height, the camera inside the sphere sees it full size
+		return distance > viewRadius ? viewRadius * projection[1][1] / distance : 1.0f;
+	}
+
+	unsigned Model3D::getLodLevel(float screenSize) {
+
+		unsigned level = 0;
+		while (level < lodLevelCount && screenSize < lodScreenSizes[level]) {
+			level++;
+		}
+		return level;
+	}
+
+	unsigned Model3D::getLodLevelCount() {
+		return (unsigned)lodLevelCount;
+	}
+
+	const std::vector<gps::Mesh>& Model3D::getMeshes() const {
+		return meshes;
+	}
+
+	// Picks the level of detail from the projected size of the bounding sphere
+	void Model3D::UpdateLodLevel(const glm::mat4& modelView, const glm::mat4& projection) {
+
+		float screenSize = getScreenSize(modelView, projection);
+
+		// Levels only change once the size is clearly past a threshold, so an object
+		// hovering around one doesn't flicker between levels
+		while (lodLevel < lodLevelCount && screenSize < lodScreenSizes[lodLevel] * (1.0f - lodHysteresis)) {
+			lodLevel++;
+		}
+		while (lodLevel > 0 && screenSize > lodScreenSizes[lodLevel - 1] * (1.0f + lodHysteresis)) {
+			lodLevel--;
+		}
 	}
 
 	BoundingBox gps::Model3D::getBoundingBox() const {
 		return boundingBox;
 	}
 
+	void Model3D::setParseThreadCount(unsigned threadCount) {
+		parseThreadCount = threadCount;
+	}
+
+	void Model3D::setQuantizeVertices(bool quantize) {
+		quantizeVertices = quantize;
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
-	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
+	void Model3D::ReadOBJ(std::string fileName, std::string basePath, ModelData& data) {
 
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
-		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret = gps::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE, parseThreadCount);
 
 		if (!err.empty()) {
 
@@ -53,220 +653,974 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
-		// Loop over shapes
+		BuildOBJMeshes(attrib, shapes, materials, basePath, data);
+		data.sourceFiles = getMaterialLibraries(fileName, basePath);
+
+		const gps::MeshData& mesh = data.meshes.back();
+		std::cout << "# of submeshes : " << mesh.submeshes.size() << std::endl;
+		std::cout << "# of vertices  : " << mesh.vertices.size() << " (" << mesh.indices.size() << " before deduplication)" << std::endl;
+	}
+
+	// Builds the vertices, indices and submeshes of a parsed .obj file, one submesh per material
+	void Model3D::BuildOBJMeshes(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+		const std::vector<tinyobj::material_t>& materials, const std::string& basePath, ModelData& data) {
+
+		int materialId;
+
+		// Shapes sharing a material are packed into a single submesh
+		std::vector<int> groupMaterials;
+		std::vector<std::vector<size_t>> groupShapes;
+
 		for (size_t s = 0; s < shapes.size(); s++) {
 
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			// Only try to read materials if the .mtl file is present
+			materialId = -1;
+			if (shapes[s].mesh.material_ids.size() > 0 && materials.size() > 0) {
+				materialId = shapes[s].mesh.material_ids[0];
+			}
+
+			size_t g = std::find(groupMaterials.begin(), groupMaterials.end(), materialId) - groupMaterials.begin();
+			if (g == groupMaterials.size()) {
+				groupMaterials.push_back(materialId);
+				groupShapes.push_back(std::vector<size_t>());
+			}
+			groupShapes[g].push_back(s);
+		}
+
+		std::vector<gps::Vertex> vertices;
+		std::vector<GLuint> indices;
+		std::vector<gps::Submesh> submeshes;
+
+		// Loop over material groups
+		for (size_t g = 0; g < groupMaterials.size(); g++) {
+
+			gps::Submesh submesh;
+			submesh.firstIndex = (GLuint)indices.size();
+			submesh.baseVertex = (GLint)vertices.size();
+			submesh.materialId = groupMaterials[g];
+			submesh.boundingBox = BoundingBox(glm::vec3(std::numeric_limits<float>::max()),
+				glm::vec3(std::numeric_limits<float>::lowest()));
+
+			// Face corners sharing the same index triple reuse the same vertex;
+			// indices are relative to the submesh base vertex
+			std::unordered_map<tinyobj::index_t, GLuint, ObjIndexHash, ObjIndexEqual> uniqueVertices;
+
+			// Loop over shapes
+			for (size_t gs = 0; gs < groupShapes[g].size(); gs++) {
+
+				const tinyobj::shape_t& shape = shapes[groupShapes[g][gs]];
+				GLuint shapeFirstIndex = (GLuint)indices.size();
+
+				// Loop over faces(polygon)
+				size_t index_offset = 0;
+				for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+
+					int fv = shape.mesh.num_face_vertices[f];
+
+					// Loop over vertices in the face.
+					for (size_t v = 0; v < fv; v++) {
+
+						// access to vertex
+						tinyobj::index_t idx = shape.mesh.indices[index_offset + v];
+
+						auto found = uniqueVertices.find(idx);
+						if (found != uniqueVertices.end()) {
 
-			// Loop over faces(polygon)
-			size_t index_offset = 0;
-			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
+							indices.push_back(found->second);
+							continue;
+						}
 
-				int fv = shapes[s].mesh.num_face_vertices[f];
+						float vx = attrib.vertices[3 * idx.vertex_index + 0];
+						float vy = attrib.vertices[3 * idx.vertex_index + 1];
+						float vz = attrib.vertices[3 * idx.vertex_index + 2];
+						float nx = attrib.normals[3 * idx.normal_index + 0];
+						float ny = attrib.normals[3 * idx.normal_index + 1];
+						float nz = attrib.normals[3 * idx.normal_index + 2];
+						float tx = 0.0f;
+						float ty = 0.0f;
 
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
+						if (idx.texcoord_index != -1) {
 
-				// Loop over vertices in the face.
-				for (size_t v = 0; v < fv; v++) {
+							tx = attrib.texcoords[2 * idx.texcoord_index + 0];
+							ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+						}
 
-					// access to vertex
-					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+						glm::vec3 vertexPosition(vx, vy, vz);
+						glm::vec3 vertexNormal(nx, ny, nz);
+						glm::vec2 vertexTexCoords(tx, ty);
 
-					float vx = attrib.vertices[3 * idx.vertex_index + 0];
-					float vy = attrib.vertices[3 * idx.vertex_index + 1];
-					float vz = attrib.vertices[3 * idx.vertex_index + 2];
-					float nx = attrib.normals[3 * idx.normal_index + 0];
-					float ny = attrib.normals[3 * idx.normal_index + 1];
-					float nz = attrib.normals[3 * idx.normal_index + 2];
-					float tx = 0.0f;
-					float ty = 0.0f;
+						gps::Vertex currentVertex;
+						currentVertex.Position = vertexPosition;
+						currentVertex.Normal = vertexNormal;
+						currentVertex.TexCoords = vertexTexCoords;
 
-					if (idx.texcoord_index != -1) {
+						// Update the bounding box with this vertex
+						data.boundingBox.min.x = std::min(data.boundingBox.min.x, vertexPosition.x);
+						data.boundingBox.min.y = std::min(data.boundingBox.min.y, vertexPosition.y);
+						data.boundingBox.min.z = std::min(data.boundingBox.min.z, vertexPosition.z);
 
-						tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-						ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+						data.boundingBox.max.x = std::max(data.boundingBox.max.x, vertexPosition.x);
+						data.boundingBox.max.y = std::max(data.boundingBox.max.y, vertexPosition.y);
+						data.boundingBox.max.z = std::max(data.boundingBox.max.z, vertexPosition.z);
+
+						submesh.boundingBox.min = glm::min(submesh.boundingBox.min, vertexPosition);
+						submesh.boundingBox.max = glm::max(submesh.boundingBox.max, vertexPosition);
+
+						GLuint newIndex = (GLuint)(vertices.size() - submesh.baseVertex);
+						uniqueVertices.emplace(idx, newIndex);
+						vertices.push_back(currentVertex);
+
+						indices.push_back(newIndex);
 					}
 
-					glm::vec3 vertexPosition(vx, vy, vz);
-					glm::vec3 vertexNormal(nx, ny, nz);
-					glm::vec2 vertexTexCoords(tx, ty);
+					index_offset += fv;
+				}
 
-					gps::Vertex currentVertex;
-					currentVertex.Position = vertexPosition;
-					currentVertex.Normal = vertexNormal;
-					currentVertex.TexCoords = vertexTexCoords;
+				// Corners reusing vertices of earlier shapes count too, the bounds come from the indices
+				gps::SubmeshRange range;
+				range.firstIndex = shapeFirstIndex;
+				range.indexCount = (GLsizei)(indices.size() - shapeFirstIndex);
+				range.boundingBox = BoundingBox(glm::vec3(std::numeric_limits<float>::max()),
+					glm::vec3(std::numeric_limits<float>::lowest()));
+				for (size_t i = range.firstIndex; i < indices.size(); i++) {
+					const glm::vec3& position = vertices[submesh.baseVertex + indices[i]].Position;
+					range.boundingBox.min = glm::min(range.boundingBox.min, position);
+					range.boundingBox.max = glm::max(range.boundingBox.max, position);
+				}
+				if (range.indexCount > 0) {
+					submesh.ranges.push_back(range);
+				}
+			}
 
-					// Update the bounding box with this vertex
-					boundingBox.min.x = std::min(boundingBox.min.x, vertexPosition.x);
-					boundingBox.min.y = std::min(boundingBox.min.y, vertexPosition.y);
-					boundingBox.min.z = std::min(boundingBox.min.z, vertexPosition.z);
+			submesh.indexCount = (GLsizei)(indices.size() - submesh.firstIndex);
+			// A single shape is culled with the submesh
+			if (submesh.ranges.size() < 2) {
+				submesh.ranges.clear();
+			}
 
-					boundingBox.max.x = std::max(boundingBox.max.x, vertexPosition.x);
-					boundingBox.max.y = std::max(boundingBox.max.y, vertexPosition.y);
-					boundingBox.max.z = std::max(boundingBox.max.z, vertexPosition.z);
+			materialId = submesh.materialId;
+			if (materialId != -1) {
 
-					vertices.push_back(currentVertex);
+				gps::Material currentMaterial;
+				currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
+				currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
+				currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
 
-					indices.push_back((GLuint)(index_offset + v));
+				//ambient texture
+				std::string ambientTexturePath = materials[materialId].ambient_texname;
+
+				if (!ambientTexturePath.empty()) {
+
+					gps::Texture currentTexture;
+					currentTexture.id = 0;
+					currentTexture.type = "ambientTexture";
+					currentTexture.path = basePath + ambientTexturePath;
+					submesh.textures.push_back(currentTexture);
 				}
 
-				index_offset += fv;
+				//diffuse texture
+				std::string diffuseTexturePath = materials[materialId].diffuse_texname;
+
+				if (!diffuseTexturePath.empty()) {
+
+					gps::Texture currentTexture;
+					currentTexture.id = 0;
+					currentTexture.type = "diffuseTexture";
+					currentTexture.path = basePath + diffuseTexturePath;
+					submesh.textures.push_back(currentTexture);
+				}
+
+				//specular texture
+				std::string specularTexturePath = materials[materialId].specular_texname;
+
+				if (!specularTexturePath.empty()) {
+
+					gps::Texture currentTexture;
+					currentTexture.id = 0;
+					currentTexture.type = "specularTexture";
+					currentTexture.path = basePath + specularTexturePath;
+					submesh.textures.push_back(currentTexture);
+				}
 			}
 
-			// get material id
-			// Only try to read materials if the .mtl file is present
-			size_t a = shapes[s].mesh.material_ids.size();
+			submeshes.push_back(submesh);
+		}
 
-			if (a > 0 && materials.size()>0) {
+		data.meshes.push_back(gps::MeshData());
+		gps::MeshData& mesh = data.meshes.back();
+		mesh.vertices.swap(vertices);
+		mesh.indices.swap(indices);
+		mesh.submeshes.swap(submeshes);
+	}
 
-				materialId = shapes[s].mesh.material_ids[0];
-				if (materialId != -1) {
+	// Clusters may be drawn out of cache order while the ACMR grows by less than 5%
+	const float overdrawThreshold = 1.05f;
 
-					gps::Material currentMaterial;
-					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
-					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
-					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
+	// Reorders the meshes read from the .obj file for the post-transform vertex cache,
+	// fetch locality and overdraw, reporting ACMR/ATVR before and after
+	void Model3D::OptimizeMeshes(ModelData& data) {
 
-					//ambient texture
-					std::string ambientTexturePath = materials[materialId].ambient_texname;
+		VertexCacheStats before;
+		VertexCacheStats after;
 
-					if (!ambientTexturePath.empty()) {
+		for (size_t m = 0; m < data.meshes.size(); m++) {
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-						textures.push_back(currentTexture);
+			MeshData& mesh = data.meshes[m];
+
+			for (size_t sm = 0; sm < mesh.submeshes.size(); sm++) {
+
+				const Submesh& submesh = mesh.submeshes[sm];
+				before += AnalyzeVertexCache(mesh.indices.data() + submesh.firstIndex, submesh.indexCount,
+					mesh.vertices.size() - submesh.baseVertex);
+			}
+
+			OptimizeMesh(mesh.vertices, mesh.indices, mesh.submeshes, overdrawThreshold);
+
+			for (size_t sm = 0; sm < mesh.submeshes.size(); sm++) {
+
+				const Submesh& submesh = mesh.submeshes[sm];
+				after += AnalyzeVertexCache(mesh.indices.data() + submesh.firstIndex, submesh.indexCount,
+					mesh.vertices.size() - submesh.baseVertex);
+			}
+		}
+
+		std::cout << "ACMR           : " << before.getACMR() << " -> " << after.getACMR() << std::endl;
+		std::cout << "ATVR           : " << before.getATVR() << " -> " << after.getATVR() << std::endl;
+	}
+
+	// Builds the simplified levels of detail of the meshes read from the .obj file
+	void Model3D::GenerateLods(ModelData& data) {
+
+		for (size_t m = 0; m < data.meshes.size(); m++) {
+
+			MeshData& mesh = data.meshes[m];
+			gps::GenerateLods(mesh.vertices, mesh.indices, mesh.submeshes, lodRatios, lodLevelCount);
+
+			// Level 0 triangle counts followed by each simplified level
+			std::vector<size_t> triangles(lodLevelCount + 1, 0);
+			for (size_t sm = 0; sm < mesh.submeshes.size(); sm++) {
+
+				const Submesh& submesh = mesh.submeshes[sm];
+				triangles[0] += submesh.indexCount / 3;
+				for (size_t l = 0; l < lodLevelCount; l++) {
+					const SubmeshLod& lod = submesh.lods.empty() ? SubmeshLod{ submesh.firstIndex, submesh.indexCount } :
+						submesh.lods[std::min(l, submesh.lods.size() - 1)];
+					triangles[l + 1] += lod.indexCount / 3;
+				}
+			}
+
+			std::cout << "# of triangles : ";
+			for (size_t l = 0; l < triangles.size(); l++) {
+				std::cout << (l ? " / " : "") << triangles[l];
+			}
+			std::cout << " (per level of detail)" << std::endl;
+		}
+	}
+
+	// A mesh placed in the scene by a node
+	struct GltfPlacement {
+		size_t mesh;
+		glm::mat4 world;
+	};
+
+	// Local matrix of a node, given either as a matrix or as translation, rotation and scale
+	static glm::mat4 getNodeMatrix(const tinygltf::Node& node) {
+
+		glm::mat4 matrix(1.0f);
+		if (node.matrix.size() == 16) {
+			for (int i = 0; i < 16; i++) {
+				matrix[i / 4][i % 4] = (float)node.matrix[i];
+			}
+			return matrix;
+		}
+
+		if (node.translation.size() == 3) {
+			matrix = glm::translate(matrix, glm::vec3((float)node.translation[0], (float)node.translation[1], (float)node.translation[2]));
+		}
+		if (node.rotation.size() == 4) {
+			// Stored x, y, z, w
+			matrix = matrix * glm::mat4_cast(glm::quat((float)node.rotation[3], (float)node.rotation[0],
+				(float)node.rotation[1], (float)node.rotation[2]));
+		}
+		if (node.scale.size() == 3) {
+			matrix = glm::scale(matrix, glm::vec3((float)node.scale[0], (float)node.scale[1], (float)node.scale[2]));
+		}
+		return matrix;
+	}
+
+	// Walks the node hierarchy of the default scene, every mesh a node holds with the node's world matrix.
+	// Without scenes the meshes are placed as they are stored.
+	static std::vector<GltfPlacement> getGltfPlacements(const tinygltf::Model& model) {
+
+		std::vector<GltfPlacement> placements;
+
+		int scene = model.defaultScene >= 0 ? model.defaultScene : 0;
+		if (scene >= (int)model.scenes.size()) {
+			for (size_t m = 0; m < model.meshes.size(); m++) {
+				GltfPlacement placement = { m, glm::mat4(1.0f) };
+				placements.push_back(placement);
+			}
+			return placements;
+		}
+
+		// Nodes with their parent's world matrix; a node has one parent, seeing it twice means a cycle
+		std::vector<std::pair<int, glm::mat4>> pending;
+		std::vector<bool> visited(model.nodes.size(), false);
+		const std::vector<int>& roots = model.scenes[scene].nodes;
+		for (size_t r = roots.size(); r-- > 0;) {
+			pending.push_back(std::make_pair(roots[r], glm::mat4(1.0f)));
+		}
+
+		while (!pending.empty()) {
+
+			int node = pending.back().first;
+			glm::mat4 parent = pending.back().second;
+			pending.pop_back();
+
+			if (node < 0 || node >= (int)model.nodes.size() || visited[node]) {
+				continue;
+			}
+			visited[node] = true;
+
+			glm::mat4 world = parent * getNodeMatrix(model.nodes[node]);
+			if (model.nodes[node].mesh >= 0 && model.nodes[node].mesh < (int)model.meshes.size()) {
+				GltfPlacement placement = { (size_t)model.nodes[node].mesh, world };
+				placements.push_back(placement);
+			}
+
+			const std::vector<int>& children = model.nodes[node].children;
+			for (size_t c = children.size(); c-- > 0;) {
+				pending.push_back(std::make_pair(children[c], world));
+			}
+		}
+
+		return placements;
+	}
+
+	// Does the parsing of the .gltf/.glb file, keeping its binary buffers as they are
+	void Model3D::ReadGLTF(std::string fileName, ModelData& data) {
+
+		std::cout << "Loading : " << fileName << std::endl;
+		tinygltf::Model model;
+		tinygltf::TinyGLTF loader;
+
+		// Images are decoded straight into the upload queue. glTF texture coordinates start at
+		// the top row, so unlike .obj textures they are kept unflipped.
+		loader.SetImageLoader([&data, &fileName](tinygltf::Image* image, const int imageIndex, std::string*,
+			std::string* warn, int, int, const unsigned char* bytes, int size, void*) {
+
+			TextureImage decoded;
+			decoded.path = fileName + "#image" + std::to_string(imageIndex);
+			decoded.width = 0;
+			decoded.height = 0;
+
+			int n;
+			decoded.pixels = stbi_load_from_memory(bytes, size, &decoded.width, &decoded.height, &n, 4);
+			if (!decoded.pixels) {
+				*warn += "could not decode image[" + std::to_string(imageIndex) + "] " + image->uri + "\n";
+			}
+
+			image->width = decoded.width;
+			image->height = decoded.height;
+			image->component = 4;
+			image->bits = 8;
+			data.images.push_back(decoded);
+			return true;
+		}, NULL);
+
+		std::string err;
+		std::string warn;
+		bool ret;
+		if (getExtension(fileName) == "gltf") {
+			ret = loader.LoadASCIIFromFile(&model, &err, &warn, fileName);
+		} else {
+			ret = loader.LoadBinaryFromFile(&model, &err, &warn, fileName);
+		}
+
+		if (!warn.empty()) {
+			std::cerr << warn << std::endl;
+		}
+
+		if (!err.empty()) {
+			std::cerr << err << std::endl;
+		}
+
+		if (!ret) {
+
+			exit(1);
+		}
+
+		std::cout << "# of meshes    : " << model.meshes.size() << std::endl;
+		std::cout << "# of materials : " << model.materials.size() << std::endl;
+
+		// One mesh per glTF buffer; each primitive reads it through its own accessors.
+		// A mesh placed by several nodes gets one submesh per node, reading the same
+		// vertices and moved by the node's world matrix when drawn.
+		std::vector<std::vector<gps::Submesh>> bufferSubmeshes(model.buffers.size());
+		std::vector<size_t> bufferStart(model.buffers.size(), (size_t)-1);
+		std::vector<size_t> bufferEnd(model.buffers.size(), 0);
+
+		const char* attributeNames[3] = { "POSITION", "NORMAL", "TEXCOORD_0" };
+
+		std::vector<GltfPlacement> placements = getGltfPlacements(model);
+
+		for (size_t n = 0; n < placements.size(); n++) {
+
+			size_t m = placements[n].mesh;
+			const glm::mat4& world = placements[n].world;
+
+			for (size_t p = 0; p < model.meshes[m].primitives.size(); p++) {
+
+				const tinygltf::Primitive& primitive = model.meshes[m].primitives[p];
+
+				if (primitive.mode != TINYGLTF_MODE_TRIANGLES || primitive.attributes.count("POSITION") == 0) {
+					std::cerr << "WARNING: skipping primitive " << p << " of mesh " << m << " (not triangles)" << std::endl;
+					continue;
+				}
+
+				// Accessors of the primitive, the indices last
+				std::vector<int> accessors;
+				for (int a = 0; a < 3; a++) {
+					std::map<std::string, int>::const_iterator found = primitive.attributes.find(attributeNames[a]);
+					accessors.push_back(found != primitive.attributes.end() ? found->second : -1);
+				}
+				accessors.push_back(primitive.indices);
+
+				// Every accessor must be a plain view into the same buffer
+				int buffer = -1;
+				bool supported = true;
+				for (size_t a = 0; a < accessors.size() && supported; a++) {
+
+					if (accessors[a] < 0) {
+						continue;
 					}
 
-					//diffuse texture
-					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
+					const tinygltf::Accessor& accessor = model.accessors[accessors[a]];
+					if (accessor.bufferView < 0 || accessor.sparse.isSparse) {
+						supported = false;
+						break;
+					}
 
-					if (!diffuseTexturePath.empty()) {
+					int viewBuffer = model.bufferViews[accessor.bufferView].buffer;
+					supported = buffer == -1 || buffer == viewBuffer;
+					buffer = viewBuffer;
+				}
 
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-						textures.push_back(currentTexture);
+				if (!supported) {
+					std::cerr << "WARNING: skipping primitive " << p << " of mesh " << m << " (sparse or split across buffers)" << std::endl;
+					continue;
+				}
+
+				gps::Submesh submesh;
+				submesh.firstIndex = 0;
+				submesh.baseVertex = 0;
+				submesh.materialId = primitive.material;
+				submesh.nodeMatrix = world;
+
+				for (GLuint a = 0; a < 3; a++) {
+
+					if (accessors[a] < 0) {
+						continue;
 					}
 
-					//specular texture
-					std::string specularTexturePath = materials[materialId].specular_texname;
+					const tinygltf::Accessor& accessor = model.accessors[accessors[a]];
+					const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+
+					gps::VertexAttribute attribute;
+					attribute.location = a;
+					attribute.size = tinygltf::GetNumComponentsInType(accessor.type);
+					attribute.type = accessor.componentType;
+					attribute.normalized = accessor.normalized ? GL_TRUE : GL_FALSE;
+					attribute.stride = accessor.ByteStride(view);
+					attribute.offset = view.byteOffset + accessor.byteOffset;
+					submesh.attributes.push_back(attribute);
+
+					size_t end = attribute.offset + (accessor.count - 1) * attribute.stride +
+						attribute.size * tinygltf::GetComponentSizeInBytes(accessor.componentType);
+					bufferStart[buffer] = std::min(bufferStart[buffer], attribute.offset);
+					bufferEnd[buffer] = std::max(bufferEnd[buffer], end);
+				}
+
+				const tinygltf::Accessor& positions = model.accessors[accessors[0]];
+				if (primitive.indices >= 0) {
 
-					if (!specularTexturePath.empty()) {
+					const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
+					const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+					size_t offset = view.byteOffset + accessor.byteOffset;
+					size_t indexSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+
+					submesh.indexType = accessor.componentType;
+					submesh.indexCount = (GLsizei)accessor.count;
+					// Converted to a buffer-relative index below
+					submesh.firstIndex = (GLuint)offset;
+
+					bufferStart[buffer] = std::min(bufferStart[buffer], offset);
+					bufferEnd[buffer] = std::max(bufferEnd[buffer], offset + accessor.count * indexSize);
+				} else {
+
+					submesh.indexType = GL_NONE;
+					submesh.indexCount = (GLsizei)positions.count;
+				}
+
+				// The position accessor must carry its bounds, a submesh without them is unbounded
+				submesh.boundingBox = BoundingBox(glm::vec3(std::numeric_limits<float>::lowest()),
+					glm::vec3(std::numeric_limits<float>::max()));
+				if (positions.minValues.size() == 3 && positions.maxValues.size() == 3) {
+
+					for (int i = 0; i < 3; i++) {
+						submesh.boundingBox.min[i] = (float)positions.minValues[i];
+						submesh.boundingBox.max[i] = (float)positions.maxValues[i];
+					}
+					submesh.boundingBox = submesh.boundingBox.transform(world);
+					data.boundingBox.min = glm::min(data.boundingBox.min, submesh.boundingBox.min);
+					data.boundingBox.max = glm::max(data.boundingBox.max, submesh.boundingBox.max);
+				}
+
+				//base color texture
+				if (primitive.material >= 0) {
+
+					int textureIndex = model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.index;
+					if (textureIndex >= 0 && model.textures[textureIndex].source >= 0) {
 
 						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-						textures.push_back(currentTexture);
+						currentTexture.id = 0;
+						currentTexture.type = "diffuseTexture";
+						currentTexture.path = fileName + "#image" + std::to_string(model.textures[textureIndex].source);
+						submesh.textures.push_back(currentTexture);
 					}
 				}
+
+				bufferSubmeshes[buffer].push_back(submesh);
+			}
+		}
+
+		size_t submeshCount = 0;
+		for (size_t b = 0; b < model.buffers.size(); b++) {
+
+			std::vector<gps::Submesh>& submeshes = bufferSubmeshes[b];
+			if (submeshes.empty()) {
+				continue;
+			}
+
+			// Only the range used by geometry goes to the GPU, not embedded images; the start
+			// stays 4-byte aligned so index offsets remain whole indices
+			size_t start = bufferStart[b] & ~(size_t)3;
+
+			for (size_t sm = 0; sm < submeshes.size(); sm++) {
+
+				for (size_t a = 0; a < submeshes[sm].attributes.size(); a++) {
+					submeshes[sm].attributes[a].offset -= start;
+				}
+
+				if (submeshes[sm].indexType != GL_NONE) {
+					submeshes[sm].firstIndex = (GLuint)((submeshes[sm].firstIndex - start) /
+						tinygltf::GetComponentSizeInBytes(submeshes[sm].indexType));
+				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			data.meshes.push_back(gps::MeshData());
+			gps::MeshData& mesh = data.meshes.back();
+			mesh.buffer.swap(model.buffers[b].data);
+			mesh.bufferOffset = start;
+			mesh.bufferSize = std::min(bufferEnd[b], mesh.buffer.size()) - start;
+			mesh.submeshes.swap(submeshes);
+
+			submeshCount += mesh.submeshes.size();
 		}
+
+		std::cout << "# of submeshes : " << submeshCount << std::endl;
 	}
 
-	// Retrieves a texture associated with the object - by its name and type
-	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+	// Fills in the data structure from the binary cache of the .obj file, if it is still valid
+	bool Model3D::ReadCache(std::string cacheFileName, std::string fileName, ModelData& modelData) {
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!getSourceStamp(fileName, sourceSize, sourceTime)) {
+			return false;
+		}
+
+		// The mapping stays open until the meshes are uploaded
+		MappedFile& cacheFile = modelData.cacheFile;
+		if (!cacheFile.open(cacheFileName) || cacheFile.size() < sizeof(MeshCacheHeader)) {
+			cacheFile.close();
+			return false;
+		}
 
-				if (loadedTextures[i].path == path)	{
+		const unsigned char* data = cacheFile.data();
+		size_t size = cacheFile.size();
 
-					//already loaded texture
-					return loadedTextures[i];
+		MeshCacheHeader header;
+		std::memcpy(&header, data, sizeof(header));
+
+		size_t offset = sizeof(MeshCacheHeader);
+		if (std::memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) != 0 ||
+			header.version != meshCacheVersion ||
+			header.vertexSize != sizeof(gps::Vertex) ||
+			header.sourceSize != sourceSize ||
+			header.sourceTime != sourceTime ||
+			!areDependenciesCurrent(data, size, offset, header.dependencyCount)) {
+
+			std::cout << "Mesh cache out of date : " << cacheFileName << std::endl;
+			cacheFile.close();
+			return false;
+		}
+
+		// Validate the whole file before handing out any pointer into it
+		if (!isCacheComplete(data, size, offset, header.meshCount)) {
+
+			std::cout << "Mesh cache truncated : " << cacheFileName << std::endl;
+			cacheFile.close();
+			return false;
+		}
+
+		std::cout << "Loading : " << cacheFileName << std::endl;
+
+		for (uint32_t m = 0; m < header.meshCount; m++) {
+
+			MeshCacheRecord record;
+			std::memcpy(&record, data + offset, sizeof(record));
+			offset += sizeof(MeshCacheRecord);
+
+			std::vector<gps::Submesh> submeshes;
+			for (uint32_t sm = 0; sm < record.submeshCount; sm++) {
+
+				SubmeshCacheRecord submeshRecord;
+				std::memcpy(&submeshRecord, data + offset, sizeof(submeshRecord));
+				offset += sizeof(SubmeshCacheRecord);
+
+				gps::Submesh submesh;
+				submesh.firstIndex = submeshRecord.firstIndex;
+				submesh.indexCount = (GLsizei)submeshRecord.indexCount;
+				submesh.baseVertex = submeshRecord.baseVertex;
+				submesh.materialId = submeshRecord.materialId;
+				submesh.boundingBox = BoundingBox(glm::vec3(submeshRecord.boundsMin[0], submeshRecord.boundsMin[1], submeshRecord.boundsMin[2]),
+					glm::vec3(submeshRecord.boundsMax[0], submeshRecord.boundsMax[1], submeshRecord.boundsMax[2]));
+
+				for (uint32_t l = 0; l < submeshRecord.lodCount; l++) {
+
+					SubmeshLodCacheRecord lodRecord;
+					std::memcpy(&lodRecord, data + offset, sizeof(lodRecord));
+					offset += sizeof(SubmeshLodCacheRecord);
+
+					gps::SubmeshLod lod;
+					lod.firstIndex = lodRecord.firstIndex;
+					lod.indexCount = (GLsizei)lodRecord.indexCount;
+					submesh.lods.push_back(lod);
 				}
+
+				for (uint32_t r = 0; r < submeshRecord.rangeCount; r++) {
+
+					SubmeshRangeCacheRecord rangeRecord;
+					std::memcpy(&rangeRecord, data + offset, sizeof(rangeRecord));
+					offset += sizeof(SubmeshRangeCacheRecord);
+
+					gps::SubmeshRange range;
+					range.firstIndex = rangeRecord.firstIndex;
+					range.indexCount = (GLsizei)rangeRecord.indexCount;
+					range.boundingBox = BoundingBox(glm::vec3(rangeRecord.boundsMin[0], rangeRecord.boundsMin[1], rangeRecord.boundsMin[2]),
+						glm::vec3(rangeRecord.boundsMax[0], rangeRecord.boundsMax[1], rangeRecord.boundsMax[2]));
+					submesh.ranges.push_back(range);
+				}
+
+				for (uint32_t t = 0; t < submeshRecord.textureCount; t++) {
+
+					std::string fields[2];
+					for (int f = 0; f < 2; f++) {
+
+						uint32_t length;
+						std::memcpy(&length, data + offset, sizeof(length));
+						fields[f].assign((const char*)data + offset + sizeof(length), length);
+						offset = alignCacheOffset(offset + sizeof(length) + length);
+					}
+
+					gps::Texture currentTexture;
+					currentTexture.id = 0;
+					currentTexture.type = fields[0];
+					currentTexture.path = fields[1];
+					submesh.textures.push_back(currentTexture);
+				}
+
+				submeshes.push_back(submesh);
 			}
 
-			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
-			currentTexture.type = std::string(type);
-			currentTexture.path = path;
+			modelData.meshes.push_back(gps::MeshData());
+			gps::MeshData& mesh = modelData.meshes.back();
+			mesh.submeshes.swap(submeshes);
 
-			loadedTextures.push_back(currentTexture);
+			mesh.vertexData = (const gps::Vertex*)(data + offset);
+			mesh.vertexCount = record.vertexCount;
+			offset += (size_t)record.vertexCount * sizeof(gps::Vertex);
+			mesh.indexData = (const GLuint*)(data + offset);
+			mesh.indexCount = record.indexCount;
+			offset += (size_t)record.indexCount * sizeof(GLuint);
 
-			return currentTexture;
+			std::cout << "# of submeshes : " << mesh.submeshes.size() << std::endl;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+		modelData.boundingBox = BoundingBox(glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+			glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
 
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+		return true;
+	}
 
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
+	// Writes the loaded meshes to a binary cache next to the .obj file
+	void Model3D::WriteCache(std::string cacheFileName, std::string fileName, const ModelData& data) {
+
+		MeshCacheHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+		header.version = meshCacheVersion;
+		header.vertexSize = sizeof(gps::Vertex);
+		header.meshCount = (uint32_t)data.meshes.size();
+		header.dependencyCount = (uint32_t)data.sourceFiles.size();
+		if (!getSourceStamp(fileName, header.sourceSize, header.sourceTime)) {
+			return;
 		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = data.boundingBox.min[i];
+			header.boundsMax[i] = data.boundingBox.max[i];
 		}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
+		// Write to a temporary file first so a crash never leaves a truncated cache behind
+		std::string tempFileName = cacheFileName + ".tmp";
+		std::ofstream cacheFile(tempFileName, std::ios::binary | std::ios::trunc);
+		if (!cacheFile) {
+			std::cerr << "WARNING: could not write mesh cache " << cacheFileName << std::endl;
+			return;
+		}
 
-		for (int row = 0; row < half_height; row++) {
+		const char padding[4] = { 0, 0, 0, 0 };
+		cacheFile.write((const char*)&header, sizeof(header));
 
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
+		for (size_t d = 0; d < data.sourceFiles.size(); d++) {
 
-			for (int col = 0; col < width_in_bytes; col++) {
+			DependencyCacheRecord record;
+			record.size = missingFileSize;
+			record.time = 0;
+			getSourceStamp(data.sourceFiles[d], record.size, record.time);
+			cacheFile.write((const char*)&record, sizeof(record));
 
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
+			uint32_t length = (uint32_t)data.sourceFiles[d].size();
+			cacheFile.write((const char*)&length, sizeof(length));
+			cacheFile.write(data.sourceFiles[d].data(), length);
+			cacheFile.write(padding, alignCacheOffset(length) - length);
+		}
+
+		for (size_t m = 0; m < data.meshes.size(); m++) {
+
+			const gps::MeshData& mesh = data.meshes[m];
+
+			MeshCacheRecord record;
+			record.vertexCount = (uint32_t)mesh.vertices.size();
+			record.indexCount = (uint32_t)mesh.indices.size();
+			record.submeshCount = (uint32_t)mesh.submeshes.size();
+			record.reserved = 0;
+			cacheFile.write((const char*)&record, sizeof(record));
+
+			for (size_t sm = 0; sm < mesh.submeshes.size(); sm++) {
+
+				const gps::Submesh& submesh = mesh.submeshes[sm];
+
+				SubmeshCacheRecord submeshRecord;
+				submeshRecord.firstIndex = submesh.firstIndex;
+				submeshRecord.indexCount = (uint32_t)submesh.indexCount;
+				submeshRecord.baseVertex = submesh.baseVertex;
+				submeshRecord.materialId = submesh.materialId;
+				submeshRecord.textureCount = (uint32_t)submesh.textures.size();
+				submeshRecord.lodCount = (uint32_t)submesh.lods.size();
+				submeshRecord.rangeCount = (uint32_t)submesh.ranges.size();
+				submeshRecord.reserved = 0;
+				for (int i = 0; i < 3; i++) {
+					submeshRecord.boundsMin[i] = submesh.boundingBox.min[i];
+					submeshRecord.boundsMax[i] = submesh.boundingBox.max[i];
+				}
+				cacheFile.write((const char*)&submeshRecord, sizeof(submeshRecord));
+
+				for (size_t l = 0; l < submesh.lods.size(); l++) {
+
+					SubmeshLodCacheRecord lodRecord;
+					lodRecord.firstIndex = submesh.lods[l].firstIndex;
+					lodRecord.indexCount = (uint32_t)submesh.lods[l].indexCount;
+					cacheFile.write((const char*)&lodRecord, sizeof(lodRecord));
+				}
+
+				for (size_t r = 0; r < submesh.ranges.size(); r++) {
+
+					SubmeshRangeCacheRecord rangeRecord;
+					rangeRecord.firstIndex = submesh.ranges[r].firstIndex;
+					rangeRecord.indexCount = (uint32_t)submesh.ranges[r].indexCount;
+					for (int i = 0; i < 3; i++) {
+						rangeRecord.boundsMin[i] = submesh.ranges[r].boundingBox.min[i];
+						rangeRecord.boundsMax[i] = submesh.ranges[r].boundingBox.max[i];
+					}
+					cacheFile.write((const char*)&rangeRecord, sizeof(rangeRecord));
+				}
+
+				for (size_t t = 0; t < submesh.textures.size(); t++) {
+
+					const std::string* fields[2] = { &submesh.textures[t].type, &submesh.textures[t].path };
+					for (int f = 0; f < 2; f++) {
+
+						uint32_t length = (uint32_t)fields[f]->size();
+						cacheFile.write((const char*)&length, sizeof(length));
+						cacheFile.write(fields[f]->data(), length);
+						cacheFile.write(padding, alignCacheOffset(length) - length);
+					}
+				}
+			}
+
+			cacheFile.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(gps::Vertex));
+			cacheFile.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+		}
+
+		cacheFile.close();
+		if (!cacheFile) {
+			std::remove(tempFileName.c_str());
+			return;
+		}
+
+		std::remove(cacheFileName.c_str());
+		if (std::rename(tempFileName.c_str(), cacheFileName.c_str()) != 0) {
+			std::remove(tempFileName.c_str());
+		}
+	}
+
+	// Decodes every texture referenced by the submeshes that isn't loaded yet, once per path,
+	// in parallel on the shared pool
+	void Model3D::DecodeTextures(ModelData& data) {
+
+		// Images the reader already decoded (embedded glTF images), they have no file to load
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < data.images.size(); i++) {
+			paths.push_back(data.images[i].path);
+		}
+		size_t embeddedCount = paths.size();
+
+		for (size_t m = 0; m < data.meshes.size(); m++) {
+
+			const std::vector<gps::Submesh>& submeshes = data.meshes[m].submeshes;
+			for (size_t sm = 0; sm < submeshes.size(); sm++) {
+
+				for (size_t t = 0; t < submeshes[sm].textures.size(); t++) {
+
+					const std::string& path = submeshes[sm].textures[t].path;
+					if (std::find(paths.begin(), paths.end(), path) == paths.end()) {
+						paths.push_back(path);
+					}
+				}
+			}
+		}
+		paths.erase(paths.begin(), paths.begin() + embeddedCount);
+
+		// Loaded or being decoded by another model, this one takes a reference instead
+		size_t decodedCount = 0;
+		for (size_t p = 0; p < paths.size(); p++) {
+
+			bool decode;
+			TextureHandle handle = TextureManager::acquire(paths[p], decode);
+			if (handle) {
+				data.sharedTextures.push_back(handle);
+			} else if (decode) {
+				paths[decodedCount++] = paths[p];
+			} else {
+				data.awaitedTextures.push_back(paths[p]);
 			}
 		}
+		paths.resize(decodedCount);
 
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		if (paths.empty()) {
+			return;
+		}
+
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		// Each task reports its own decode time
+		typedef std::pair<TextureImage, double> DecodedTexture;
+		std::vector<std::future<DecodedTexture>> decoding;
+		for (size_t p = 0; p < paths.size(); p++) {
 
-		return textureID;
+			std::string path = paths[p];
+			decoding.push_back(ThreadPool::getShared().submit([path]() {
+
+				ProfileScope zone("DecodeTexture");
+				Clock::time_point decodeStart = Clock::now();
+				TextureImage image = DecodeTexture(path);
+				image.contentHash = HashImage(image);
+				return DecodedTexture(image, std::chrono::duration<double, std::milli>(Clock::now() - decodeStart).count());
+			}));
+		}
+
+		// Kept in path order, so uploads happen in the same order on every run
+		for (size_t p = 0; p < decoding.size(); p++) {
+
+			DecodedTexture decoded = decoding[p].get();
+			data.images.push_back(decoded.first);
+			std::cout << "Texture        : " << decoded.first.path << " " << decoded.first.width << "x" << decoded.first.height
+				<< " (" << decoded.second << " ms)" << std::endl;
+		}
+
+		double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		std::cout << "# of textures  : " << paths.size() << " decoded in " << elapsed << " ms on "
+			<< ThreadPool::getShared().getThreadCount() << " threads, "
+			<< data.sharedTextures.size() + data.awaitedTextures.size() << " shared" << std::endl;
+	}
+
+	// Retrieves an uploaded texture associated with the object - by its path, with the given type
+	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+
+		gps::Texture currentTexture;
+		// The model holds a reference to each of its textures, the lookup can't miss a loaded one
+		currentTexture.id = TextureManager::findTextureId(path);
+		currentTexture.type = type;
+		currentTexture.path = path;
+
+		return currentTexture;
 	}
 
 	Model3D::~Model3D() {
+		Release();
+	}
+
+	void Model3D::Release() {
+
+		// A model can't go away while a worker still fills it in
+		if (loading.valid()) {
+			loading.wait();
+			loading = std::future<void>();
+		}
+
+		if (pendingData) {
 
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
+			{
+				std::lock_guard<std::mutex> lock(uploadQueueMutex);
+				uploadQueue.erase(std::remove(uploadQueue.begin(), uploadQueue.end(), this), uploadQueue.end());
+			}
 
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+			// Models waiting for the images not uploaded yet decode them themselves
+			for (size_t i = 0; i < pendingData->images.size(); i++) {
+				if (i >= pendingData->uploadedImages) {
+					TextureManager::abandon(pendingData->images[i].path);
+				}
+				FreeImage(pendingData->images[i]);
+			}
+			for (size_t i = 0; i < pendingData->sharedTextures.size(); i++) {
+				TextureManager::release(pendingData->sharedTextures[i]);
+			}
+			pendingData.reset();
+		}
+
+		// GPU memory goes with the last model using a texture
+        for (size_t i = 0; i < textures.size(); i++) {
+            TextureManager::release(textures.at(i));
         }
+        textures.clear();
 
         for (size_t i = 0; i < meshes.size(); i++) {
-
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+            meshes.at(i).Release();
         }
+        meshes.clear();
+        ready = false;
 	}
 }
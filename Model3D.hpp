@@ -2,45 +2,190 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "RenderQueue.hpp"
 #include "BoundingBox.h"
+#include "MappedFile.hpp"
+#include "TextureManager.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace gps {
 
+    // CPU side of a mesh, waiting to be uploaded
+    struct MeshData {
+
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        // When set, the buffers live in the mapped cache file instead of the vectors above
+        const Vertex* vertexData = NULL;
+        size_t vertexCount = 0;
+        const GLuint* indexData = NULL;
+        size_t indexCount = 0;
+        // Uploaded instead of the vertices above when the model is quantized
+        std::vector<QuantizedVertex> quantizedVertices;
+        // Raw glTF buffer range, read by the submeshes through their own attribute layouts
+        std::vector<unsigned char> buffer;
+        size_t bufferOffset = 0;
+        size_t bufferSize = 0;
+        // Texture ids are resolved by path once the images are uploaded
+        std::vector<Submesh> submeshes;
+    };
+
+    // Everything the loading stage produces for a model, before any GL call
+    struct ModelData {
+
+        std::vector<MeshData> meshes;
+        std::vector<TextureImage> images;
+        // Textures other models already loaded, referenced instead of decoded
+        std::vector<TextureHandle> sharedTextures;
+        // Paths another model is still decoding, referenced once that model uploads them
+        std::vector<std::string> awaitedTextures;
+        MappedFile cacheFile;
+        // Files besides the model file its meshes were read from (.mtl libraries), keying the cache
+        std::vector<std::string> sourceFiles;
+        BoundingBox boundingBox;
+        // Upload progress
+        size_t uploadedImages = 0;
+        size_t uploadedMeshes = 0;
+    };
+
+    // Bounding boxes tested against the view frustum, and how many of them were outside
+    struct CullingStats {
+
+        size_t tested;
+        size_t culled;
+    };
+
     class Model3D {
 
     public:
         ~Model3D();
 
+		// Deletes the meshes and drops the texture references while the context is still current,
+		// the destructor then has nothing left to do. Waits for a load still running.
+		void Release();
+
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// Parses the model and decodes its textures on a worker thread; the GPU upload happens
+		// in ProcessUploads, after which onReady runs on the main thread
+		void LoadModelAsync(std::string fileName, std::string basePath, std::function<void()> onReady = std::function<void()>());
+
+		// Uploads models finished by LoadModelAsync, spending about byteBudget bytes
+		// (at least one texture or mesh) per call. Must be called from the GL thread.
+		static void ProcessUploads(size_t byteBudget);
+
+		// True once the model is uploaded and drawable
+		bool isReady() const;
+
+		void Draw(const gps::Shader& shaderProgram);
+
+		// Picks the level of detail from the size of the model on screen, then draws the
+		// submeshes inside the view frustum. The caller binds the ObjectUniforms of the model.
+		void Draw(const gps::Shader& shaderProgram, const glm::mat4& modelView, const glm::mat4& projection);
+
+		// Same as the Draw above, but queues the visible submeshes for sorting instead of drawing them
+		void Submit(RenderQueue& queue, const gps::Shader& shaderProgram, const glm::mat4& modelView,
+			const glm::mat4& projection, unsigned object);
+
+		// Culling done by all models since the last reset, reset it once per frame
+		static CullingStats getCullingStats();
+		static void resetCullingStats();
+
+		// Relative margin around the level of detail thresholds before switching (0.1 = 10%)
+		void setLodHysteresis(float hysteresis);
+
+		// Level of detail picked by the last Draw, 0 = full mesh
+		unsigned getLodLevel() const;
+
+		// Diameter of the bounding sphere over the viewport height
+		float getScreenSize(const glm::mat4& modelView, const glm::mat4& projection) const;
+
+		// Level of detail for a screen size, without hysteresis, 0 = full mesh
+		static unsigned getLodLevel(float screenSize);
+		static unsigned getLodLevelCount();
+
+		const std::vector<gps::Mesh>& getMeshes() const;
 
 		BoundingBox getBoundingBox() const;
 
+		// Threads used to parse .obj files, 0 = one per core, 1 = serial tinyobj parsing
+		void setParseThreadCount(unsigned threadCount);
+
+		// Uploads .obj meshes as 16 byte quantized vertices instead of 32 byte float ones.
+		// Must be set before loading.
+		void setQuantizeVertices(bool quantize);
+
+		// Builds the vertices, indices and submeshes of a parsed .obj file into data, one submesh
+		// per material, face corners with the same index triple sharing a vertex. Grows data.boundingBox.
+		static void BuildOBJMeshes(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes,
+			const std::vector<tinyobj::material_t>& materials, const std::string& basePath, ModelData& data);
+
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
-        std::vector<gps::Texture> loadedTextures;
+		// References to the textures of the model, see TextureManager
+        std::vector<TextureHandle> textures;
 		BoundingBox boundingBox; // Store the bounding box of the model
+		unsigned parseThreadCount = 0;
+		bool quantizeVertices = false;
+		float lodHysteresis = 0.1f;
+		unsigned lodLevel = 0;
+
+		// Loading state
+		std::unique_ptr<ModelData> pendingData;
+		std::future<void> loading;
+		std::function<void()> onReady;
+		bool ready = false;
+
+		// Reads the model (from its cache when valid) and decodes its textures, without touching GL
+		void LoadModelData(std::string fileName, std::string basePath, ModelData& data);
 
 		// Does the parsing of the .obj file and fills in the data structure
-		void ReadOBJ(std::string fileName, std::string basePath);
+		void ReadOBJ(std::string fileName, std::string basePath, ModelData& data);
 
-		// Retrieves a texture associated with the object - by its name and type
-		gps::Texture LoadTexture(std::string path, std::string type);
+		// Reorders the meshes read from the .obj file for the post-transform vertex cache,
+		// fetch locality and overdraw, reporting ACMR/ATVR before and after
+		void OptimizeMeshes(ModelData& data);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Builds the simplified levels of detail of the meshes read from the .obj file
+		void GenerateLods(ModelData& data);
+
+		// Culls the submeshes and picks the level of detail, returns false when the whole model is outside
+		bool Cull(const glm::mat4& modelView, const glm::mat4& projection);
+
+		// Picks the level of detail from the projected size of the bounding sphere
+		void UpdateLodLevel(const glm::mat4& modelView, const glm::mat4& projection);
+
+		// Does the parsing of the .gltf/.glb file, keeping its binary buffers as they are
+		void ReadGLTF(std::string fileName, ModelData& data);
+
+		// Fills in the data structure from the binary cache of the .obj file, if it is still valid
+		bool ReadCache(std::string cacheFileName, std::string fileName, ModelData& data);
+
+		// Writes the loaded meshes to a binary cache next to the .obj file
+		void WriteCache(std::string cacheFileName, std::string fileName, const ModelData& data);
+
+		// Decodes every texture referenced by the submeshes that isn't loaded yet, once per path,
+		// in parallel on the shared pool
+		void DecodeTextures(ModelData& data);
+
+		// Uploads pending textures and meshes until the budget runs out, returns true when done.
+		// Also returns false, with budget left, while another model still has to upload a shared texture.
+		bool UploadStep(size_t& byteBudget);
+
+		// Retrieves an uploaded texture associated with the object - by its path, with the given type
+		gps::Texture LoadTexture(std::string path, std::string type);
     };
 }
 
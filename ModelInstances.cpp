@@ -0,0 +1,222 @@
+#include "ModelInstances.hpp"
+#include "GLState.hpp"
+#include "Frustum.hpp"
+#include "Profiler.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+namespace gps {
+
+	// Not culled, not drawn
+	static const unsigned culledLevel = ~0u;
+
+	ModelInstances::ModelInstances(const Model3D& model) : model(model) {
+	}
+
+	ModelInstances::~ModelInstances() {
+		destroy();
+	}
+
+	void ModelInstances::destroy() {
+
+		for (std::map<GLuint, GLuint>::iterator it = vertexArrays.begin(); it != vertexArrays.end(); ++it) {
+			GLState::forgetVertexArray(it->second);
+			glDeleteVertexArrays(1, &it->second);
+		}
+		vertexArrays.clear();
+		meshVertexArrays.clear();
+		if (instanceBuffer) {
+			glDeleteBuffers(1, &instanceBuffer);
+			instanceBuffer = 0;
+		}
+	}
+
+	unsigned ModelInstances::add(const glm::mat4& modelMatrix) {
+
+		unsigned id;
+		if (!freeIds.empty()) {
+			id = freeIds.back();
+			freeIds.pop_back();
+		} else {
+			id = (unsigned)slots.size();
+			slots.push_back(0);
+		}
+
+		slots[id] = instances.size();
+		ids.push_back(id);
+		instances.push_back(InstanceData());
+		worldBounds.push_back(BoundingBox());
+		setInstance(slots[id], modelMatrix);
+
+		return id;
+	}
+
+	void ModelInstances::update(unsigned id, const glm::mat4& modelMatrix) {
+
+		// Parked instances are updated every frame with the same matrix
+		size_t slot = slots[id];
+		if (instances[slot].model != modelMatrix) {
+			setInstance(slot, modelMatrix);
+		}
+	}
+
+	void ModelInstances::setInstance(size_t slot, const glm::mat4& modelMatrix) {
+
+		instances[slot].model = modelMatrix;
+		instances[slot].normalMatrix = glm::mat4(glm::inverseTranspose(glm::mat3(modelMatrix)));
+		worldBounds[slot] = model.getBoundingBox().transform(modelMatrix);
+	}
+
+	void ModelInstances::remove(unsigned id) {
+
+		// The last instance takes the place of the removed one
+		size_t slot = slots[id];
+		size_t last = instances.size() - 1;
+		instances[slot] = instances[last];
+		worldBounds[slot] = worldBounds[last];
+		ids[slot] = ids[last];
+		slots[ids[slot]] = slot;
+
+		instances.pop_back();
+		worldBounds.pop_back();
+		ids.pop_back();
+		freeIds.push_back(id);
+	}
+
+	size_t ModelInstances::size() const {
+		return instances.size();
+	}
+
+	void ModelInstances::setStreamBuffer(StreamBuffer* stream) {
+		this->stream = stream;
+	}
+
+	size_t ModelInstances::getDrawnCount() const {
+		return drawnCount;
+	}
+
+	void ModelInstances::Draw(const gps::Shader& shader, const glm::mat4& view, const glm::mat4& projection) {
+
+		ProfileScope zone("ModelInstances::Draw");
+		drawnCount = 0;
+		if (!model.isReady() || instances.empty()) {
+			return;
+		}
+
+		if (vertexArrays.empty()) {
+			setupVertexArrays();
+		}
+
+		// Instances placed while the model was loading got empty bounds
+		if (!boundsReady) {
+			for (size_t i = 0; i < instances.size(); i++) {
+				worldBounds[i] = model.getBoundingBox().transform(instances[i].model);
+			}
+			boundsReady = true;
+		}
+
+		// Bounds were moved to world space when the instances were placed
+		Frustum frustum(projection * view);
+
+		unsigned levelCount = Model3D::getLodLevelCount() + 1;
+		std::vector<size_t> levelStarts(levelCount + 1, 0);
+		instanceLevels.resize(instances.size());
+		for (size_t i = 0; i < instances.size(); i++) {
+
+			if (!frustum.isVisible(worldBounds[i])) {
+				instanceLevels[i] = culledLevel;
+				continue;
+			}
+			float screenSize = model.getScreenSize(view * instances[i].model, projection);
+			instanceLevels[i] = Model3D::getLodLevel(screenSize);
+			levelStarts[instanceLevels[i] + 1]++;
+			drawnCount++;
+		}
+
+		if (!drawnCount) {
+			return;
+		}
+
+		// Counts to offsets, then each level is written to its own range
+		for (unsigned level = 0; level < levelCount; level++) {
+			levelStarts[level + 1] += levelStarts[level];
+		}
+		std::vector<size_t> next(levelStarts.begin(), levelStarts.end() - 1);
+		visibleInstances.resize(drawnCount);
+		for (size_t i = 0; i < instances.size(); i++) {
+			if (instanceLevels[i] != culledLevel) {
+				visibleInstances[next[instanceLevels[i]]++] = instances[i];
+			}
+		}
+
+		StreamAllocation allocation;
+		if (stream) {
+			allocation = stream->write(visibleInstances.data(), visibleInstances.size() * sizeof(InstanceData), sizeof(glm::vec4));
+		} else {
+			glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+			glBufferData(GL_ARRAY_BUFFER, visibleInstances.size() * sizeof(InstanceData), visibleInstances.data(), GL_STREAM_DRAW);
+			allocation.buffer = instanceBuffer;
+			allocation.offset = 0;
+		}
+
+		GpuProfileScope gpuZone("ModelInstances::Draw");
+		const std::vector<gps::Mesh>& meshes = model.getMeshes();
+		for (unsigned level = 0; level < levelCount; level++) {
+
+			GLsizei instanceCount = (GLsizei)(levelStarts[level + 1] - levelStarts[level]);
+			if (!instanceCount) {
+				continue;
+			}
+
+			for (std::map<GLuint, GLuint>::iterator it = vertexArrays.begin(); it != vertexArrays.end(); ++it) {
+				setupInstanceAttributes(it->second, allocation.buffer, allocation.offset + levelStarts[level] * sizeof(InstanceData));
+			}
+			for (size_t m = 0; m < meshes.size(); m++) {
+				meshes[m].DrawInstanced(shader, level, meshVertexArrays[m].data(), instanceCount);
+			}
+		}
+	}
+
+	void ModelInstances::setupVertexArrays() {
+
+		glGenBuffers(1, &instanceBuffer);
+
+		const std::vector<gps::Mesh>& meshes = model.getMeshes();
+		meshVertexArrays.resize(meshes.size());
+		for (size_t m = 0; m < meshes.size(); m++) {
+
+			// Submeshes sharing a vertex array share its instanced copy too
+			for (size_t s = 0; s < meshes[m].submeshes.size(); s++) {
+
+				GLuint source = meshes[m].getVertexArray(s);
+				std::map<GLuint, GLuint>::iterator found = vertexArrays.find(source);
+				if (found == vertexArrays.end()) {
+					found = vertexArrays.insert(std::make_pair(source, meshes[m].CreateVertexArray(s))).first;
+				}
+				meshVertexArrays[m].push_back(found->second);
+			}
+		}
+	}
+
+	void ModelInstances::setupInstanceAttributes(GLuint VAO, GLuint buffer, size_t offset) {
+
+		GLState::bindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+		size_t base = offset;
+		// Model matrix columns
+		for (GLuint c = 0; c < 4; c++) {
+			glEnableVertexAttribArray(3 + c);
+			glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(GLvoid*)(base + offsetof(InstanceData, model) + c * sizeof(glm::vec4)));
+			glVertexAttribDivisor(3 + c, 1);
+		}
+		// Normal matrix columns
+		for (GLuint c = 0; c < 3; c++) {
+			glEnableVertexAttribArray(7 + c);
+			glVertexAttribPointer(7 + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(GLvoid*)(base + offsetof(InstanceData, normalMatrix) + c * sizeof(glm::vec4)));
+			glVertexAttribDivisor(7 + c, 1);
+		}
+	}
+}
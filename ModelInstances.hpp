@@ -0,0 +1,91 @@
+#ifndef ModelInstances_hpp
+#define ModelInstances_hpp
+
+#include "Model3D.hpp"
+#include "BoundingBox.h"
+#include "StreamBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <map>
+#include <vector>
+
+namespace gps {
+
+    // Per instance attributes read by shaderInstanced.vert, at locations 3 to 9
+    struct InstanceData {
+
+        glm::mat4 model;
+        // Inverse transpose of the model matrix, only the upper 3x3 is used
+        glm::mat4 normalMatrix;
+    };
+
+    // Copies of one model drawn with a single instanced draw per submesh and level of detail.
+    // Ids stay valid while other instances are added and removed.
+    class ModelInstances {
+
+    public:
+        explicit ModelInstances(const Model3D& model);
+        ~ModelInstances();
+
+        // Deletes the instanced vertex arrays and the instance buffer while the context is still current,
+        // the destructor then has nothing left to do
+        void destroy();
+
+        // Returns the id of the new instance
+        unsigned add(const glm::mat4& modelMatrix);
+
+        // Does nothing when the matrix did not change
+        void update(unsigned id, const glm::mat4& modelMatrix);
+
+        void remove(unsigned id);
+
+        size_t size() const;
+
+        // Streams the instance data through the ring instead of a buffer of the set's own
+        void setStreamBuffer(StreamBuffer* stream);
+
+        // Culls the instances against the view frustum, groups the others by level of detail
+        // and draws each group. Does nothing until the model is ready.
+        void Draw(const gps::Shader& shader, const glm::mat4& view, const glm::mat4& projection);
+
+        // Instances that passed culling in the last Draw
+        size_t getDrawnCount() const;
+
+    private:
+        const Model3D& model;
+        // Packed, instance i has id ids[i]
+        std::vector<InstanceData> instances;
+        std::vector<BoundingBox> worldBounds;
+        std::vector<unsigned> ids;
+        // Position of each id in the packed arrays
+        std::vector<size_t> slots;
+        std::vector<unsigned> freeIds;
+        // Set once the bounds were computed from the loaded model
+        bool boundsReady = false;
+
+        // Visible instances of the frame, sorted by level of detail
+        std::vector<unsigned> instanceLevels;
+        std::vector<InstanceData> visibleInstances;
+        size_t drawnCount = 0;
+
+        GLuint instanceBuffer = 0;
+        StreamBuffer* stream = NULL;
+        // Instanced copy of each vertex array of the model, and the copies each mesh draws with
+        std::map<GLuint, GLuint> vertexArrays;
+        std::vector<std::vector<GLuint> > meshVertexArrays;
+
+        // Derives the normal matrix and world bounds of the instance in slot
+        void setInstance(size_t slot, const glm::mat4& modelMatrix);
+
+        void setupVertexArrays();
+
+        // Points the instance attributes of a vertex array at instance data starting at offset in buffer
+        void setupInstanceAttributes(GLuint VAO, GLuint buffer, size_t offset);
+
+        ModelInstances(const ModelInstances&);
+        ModelInstances& operator=(const ModelInstances&);
+    };
+}
+
+#endif /* ModelInstances_hpp */
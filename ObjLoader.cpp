@@ -0,0 +1,351 @@
+#include "ObjLoader.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstring>
+#include <map>
+#include <streambuf>
+#include <istream>
+
+namespace gps {
+
+	// Files smaller than this are not worth splitting
+	static const size_t minChunkSize = 256 * 1024;
+
+	// Read-only std::istream source over a block of memory
+	struct MemoryStreamBuffer : public std::streambuf {
+		MemoryStreamBuffer(const char* begin, const char* end) {
+			char* data = const_cast<char*>(begin);
+			setg(data, data, data + (end - begin));
+		}
+	};
+
+	// Records 'mtllib' names instead of reading them; the merge loads them in file order
+	struct MtllibRecorder : public tinyobj::MaterialReader {
+		std::vector<std::string>* names;
+
+		explicit MtllibRecorder(std::vector<std::string>* names) : names(names) {}
+
+		virtual bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials,
+			std::map<std::string, int>* /*matMap*/, std::string* /*err*/) {
+			names->push_back(matId);
+			// LoadObjWithCallback hands materials.at(0) to the callback
+			materials->push_back(tinyobj::material_t());
+			return true;
+		}
+	};
+
+	enum ObjRecordType { OBJ_FACE, OBJ_USEMTL, OBJ_MTLLIB, OBJ_GROUP, OBJ_OBJECT };
+
+	// One statement of the file that affects shape grouping, in file order
+	struct ObjRecord {
+		ObjRecordType type;
+		// OBJ_FACE: range in ObjChunk::faceIndices and the chunk-local attribute counts at this face
+		size_t first;
+		int count;
+		int vertexCount;
+		int normalCount;
+		int texcoordCount;
+		// OBJ_USEMTL / OBJ_MTLLIB / OBJ_GROUP / OBJ_OBJECT: index in ObjChunk::names
+		size_t name;
+	};
+
+	struct ObjChunk {
+		std::vector<float> vertices;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+		std::vector<tinyobj::index_t> faceIndices; // raw 1-based/relative indices, 0 = unused
+		std::vector<ObjRecord> records;
+		std::vector<std::string> names;
+		std::vector<std::string> mtllibNames;
+		std::string err;
+		bool ok;
+	};
+
+	static ObjRecord makeNameRecord(ObjChunk* chunk, ObjRecordType type, const std::string& name) {
+		ObjRecord record = ObjRecord();
+		record.type = type;
+		record.name = chunk->names.size();
+		chunk->names.push_back(name);
+		return record;
+	}
+
+	static void chunkVertex(void* userData, float x, float y, float z, float /*w*/) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		chunk->vertices.push_back(x);
+		chunk->vertices.push_back(y);
+		chunk->vertices.push_back(z);
+	}
+
+	static void chunkNormal(void* userData, float x, float y, float z) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		chunk->normals.push_back(x);
+		chunk->normals.push_back(y);
+		chunk->normals.push_back(z);
+	}
+
+	static void chunkTexcoord(void* userData, float x, float y, float /*z*/) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		chunk->texcoords.push_back(x);
+		chunk->texcoords.push_back(y);
+	}
+
+	static void chunkFace(void* userData, tinyobj::index_t* indices, int numIndices) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		ObjRecord record = ObjRecord();
+		record.type = OBJ_FACE;
+		record.first = chunk->faceIndices.size();
+		record.count = numIndices;
+		record.vertexCount = (int)(chunk->vertices.size() / 3);
+		record.normalCount = (int)(chunk->normals.size() / 3);
+		record.texcoordCount = (int)(chunk->texcoords.size() / 2);
+		chunk->faceIndices.insert(chunk->faceIndices.end(), indices, indices + numIndices);
+		chunk->records.push_back(record);
+	}
+
+	static void chunkUsemtl(void* userData, const char* name, int /*materialId*/) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		chunk->records.push_back(makeNameRecord(chunk, OBJ_USEMTL, name));
+	}
+
+	static void chunkMtllib(void* userData, const tinyobj::material_t* /*materials*/, int /*numMaterials*/) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		chunk->records.push_back(makeNameRecord(chunk, OBJ_MTLLIB, chunk->mtllibNames.back()));
+	}
+
+	static void chunkGroup(void* userData, const char** names, int numNames) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		chunk->records.push_back(makeNameRecord(chunk, OBJ_GROUP, numNames > 0 ? names[0] : ""));
+	}
+
+	static void chunkObject(void* userData, const char* name) {
+		ObjChunk* chunk = static_cast<ObjChunk*>(userData);
+		chunk->records.push_back(makeNameRecord(chunk, OBJ_OBJECT, name));
+	}
+
+	static void parseChunk(const char* begin, const char* end, ObjChunk* chunk) {
+
+		MemoryStreamBuffer buffer(begin, end);
+		std::istream stream(&buffer);
+		MtllibRecorder recorder(&chunk->mtllibNames);
+
+		tinyobj::callback_t callback;
+		callback.vertex_cb = chunkVertex;
+		callback.normal_cb = chunkNormal;
+		callback.texcoord_cb = chunkTexcoord;
+		callback.index_cb = chunkFace;
+		callback.usemtl_cb = chunkUsemtl;
+		callback.mtllib_cb = chunkMtllib;
+		callback.group_cb = chunkGroup;
+		callback.object_cb = chunkObject;
+
+		chunk->ok = tinyobj::LoadObjWithCallback(stream, callback, chunk, &recorder, &chunk->err);
+	}
+
+	// Same as tinyobj's fixIndex, raw 0 marks an unused normal/texcoord slot
+	static int resolveIndex(int idx, int count) {
+		if (idx > 0) return idx - 1;
+		if (idx == 0) return 0;
+		return count + idx;
+	}
+
+	// Mirrors tinyobj's exportFaceGroupToShape
+	static bool exportFaces(tinyobj::shape_t* shape, const std::vector<tinyobj::index_t>& faceIndices,
+		const std::vector<unsigned char>& faceSizes, int materialId, const std::string& name, bool triangulate) {
+
+		if (faceSizes.empty()) {
+			return false;
+		}
+
+		size_t offset = 0;
+		for (size_t f = 0; f < faceSizes.size(); f++) {
+
+			const tinyobj::index_t* face = &faceIndices[offset];
+			size_t npolys = faceSizes[f];
+
+			if (triangulate) {
+				// Polygon -> triangle fan
+				for (size_t k = 2; k < npolys; k++) {
+					shape->mesh.indices.push_back(face[0]);
+					shape->mesh.indices.push_back(face[k - 1]);
+					shape->mesh.indices.push_back(face[k]);
+					shape->mesh.num_face_vertices.push_back(3);
+					shape->mesh.material_ids.push_back(materialId);
+				}
+			}
+			else {
+				shape->mesh.indices.insert(shape->mesh.indices.end(), face, face + npolys);
+				shape->mesh.num_face_vertices.push_back((unsigned char)npolys);
+				shape->mesh.material_ids.push_back(materialId);
+			}
+
+			offset += npolys;
+		}
+
+		shape->name = name;
+
+		return true;
+	}
+
+	bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+		std::vector<tinyobj::material_t>* materials, std::string* err,
+		const char* filename, const char* mtl_basepath, bool triangulate, unsigned threadCount) {
+
+		ThreadPool& pool = ThreadPool::getShared();
+		if (threadCount == 0) {
+			threadCount = pool.getThreadCount();
+		}
+
+		MappedFile file;
+		if (threadCount <= 1 || !file.open(filename) || file.size() < 2 * minChunkSize) {
+			return tinyobj::LoadObj(attrib, shapes, materials, err, filename, mtl_basepath, triangulate);
+		}
+
+		const char* data = (const char*)file.data();
+		const char* dataEnd = data + file.size();
+
+		// Split at line boundaries
+		size_t chunkCount = std::min<size_t>(threadCount, file.size() / minChunkSize);
+		std::vector<const char*> bounds;
+		bounds.push_back(data);
+		for (size_t c = 1; c < chunkCount; c++) {
+
+			const char* split = std::max(bounds.back(), data + file.size() * c / chunkCount);
+			while (split < dataEnd && *split != '\n') {
+				split++;
+			}
+			if (split < dataEnd) {
+				split++;
+			}
+			bounds.push_back(split);
+		}
+		bounds.push_back(dataEnd);
+
+		std::vector<ObjChunk> chunks(chunkCount);
+		std::vector<std::future<void>> pending;
+		for (size_t c = 0; c < chunkCount; c++) {
+
+			const char* begin = bounds[c];
+			const char* end = bounds[c + 1];
+			ObjChunk* chunk = &chunks[c];
+			pending.push_back(pool.submit([begin, end, chunk]() { parseChunk(begin, end, chunk); }));
+		}
+		for (size_t c = 0; c < pending.size(); c++) {
+			pending[c].get();
+		}
+
+		attrib->vertices.clear();
+		attrib->normals.clear();
+		attrib->texcoords.clear();
+		shapes->clear();
+
+		for (size_t c = 0; c < chunkCount; c++) {
+			if (err) {
+				(*err) += chunks[c].err;
+			}
+			if (!chunks[c].ok) {
+				return false;
+			}
+		}
+
+		// Replay the grouping statements in file order, exactly like tinyobj::LoadObj
+		std::string basePath = mtl_basepath ? mtl_basepath : "";
+		tinyobj::MaterialFileReader materialReader(basePath);
+		std::map<std::string, int> materialMap;
+		int material = -1;
+		std::string name;
+		tinyobj::shape_t shape;
+		std::vector<tinyobj::index_t> faceIndices;
+		std::vector<unsigned char> faceSizes;
+
+		int vertexOffset = 0;
+		int normalOffset = 0;
+		int texcoordOffset = 0;
+
+		for (size_t c = 0; c < chunkCount; c++) {
+
+			const ObjChunk& chunk = chunks[c];
+
+			for (size_t r = 0; r < chunk.records.size(); r++) {
+
+				const ObjRecord& record = chunk.records[r];
+
+				if (record.type == OBJ_FACE) {
+
+					int vertexCount = vertexOffset + record.vertexCount;
+					int normalCount = normalOffset + record.normalCount;
+					int texcoordCount = texcoordOffset + record.texcoordCount;
+
+					for (int i = 0; i < record.count; i++) {
+
+						const tinyobj::index_t& raw = chunk.faceIndices[record.first + i];
+						tinyobj::index_t idx;
+						idx.vertex_index = resolveIndex(raw.vertex_index, vertexCount);
+						idx.normal_index = raw.normal_index == 0 ? -1 : resolveIndex(raw.normal_index, normalCount);
+						idx.texcoord_index = raw.texcoord_index == 0 ? -1 : resolveIndex(raw.texcoord_index, texcoordCount);
+						faceIndices.push_back(idx);
+					}
+					faceSizes.push_back((unsigned char)record.count);
+					continue;
+				}
+
+				const std::string& recordName = chunk.names[record.name];
+
+				if (record.type == OBJ_USEMTL) {
+
+					std::map<std::string, int>::const_iterator found = materialMap.find(recordName);
+					int newMaterialId = found != materialMap.end() ? found->second : -1;
+
+					if (newMaterialId != material) {
+						exportFaces(&shape, faceIndices, faceSizes, material, name, triangulate);
+						faceIndices.clear();
+						faceSizes.clear();
+						material = newMaterialId;
+					}
+				}
+				else if (record.type == OBJ_MTLLIB) {
+
+					std::string mtlErr;
+					bool ok = materialReader(recordName, materials, &materialMap, &mtlErr);
+					if (err) {
+						(*err) += mtlErr;
+					}
+					if (!ok) {
+						return false;
+					}
+				}
+				else {
+
+					// 'g' and 'o' flush the current shape
+					if (exportFaces(&shape, faceIndices, faceSizes, material, name, triangulate)) {
+						shapes->push_back(shape);
+					}
+					shape = tinyobj::shape_t();
+					faceIndices.clear();
+					faceSizes.clear();
+					name = recordName;
+				}
+			}
+
+			vertexOffset += (int)(chunk.vertices.size() / 3);
+			normalOffset += (int)(chunk.normals.size() / 3);
+			texcoordOffset += (int)(chunk.texcoords.size() / 2);
+		}
+
+		if (exportFaces(&shape, faceIndices, faceSizes, material, name, triangulate) || shape.mesh.indices.size()) {
+			shapes->push_back(shape);
+		}
+
+		attrib->vertices.reserve((size_t)vertexOffset * 3);
+		attrib->normals.reserve((size_t)normalOffset * 3);
+		attrib->texcoords.reserve((size_t)texcoordOffset * 2);
+		for (size_t c = 0; c < chunkCount; c++) {
+			attrib->vertices.insert(attrib->vertices.end(), chunks[c].vertices.begin(), chunks[c].vertices.end());
+			attrib->normals.insert(attrib->normals.end(), chunks[c].normals.begin(), chunks[c].normals.end());
+			attrib->texcoords.insert(attrib->texcoords.end(), chunks[c].texcoords.begin(), chunks[c].texcoords.end());
+		}
+
+		return true;
+	}
+
+}
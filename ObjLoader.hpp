@@ -0,0 +1,23 @@
+#ifndef ObjLoader_hpp
+#define ObjLoader_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Drop-in replacement for tinyobj::LoadObj that splits the file at line boundaries
+    // and tokenizes the chunks on the shared thread pool. The chunks are merged with
+    // global index offsets, giving the same attrib/shapes/materials as the serial loader
+    // (except 't' subdivision tags, which are not read).
+    // threadCount 0 = size of the shared pool, 1 = serial tinyobj::LoadObj.
+    // Must not be called from a task running on the shared pool.
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+        std::vector<tinyobj::material_t>* materials, std::string* err,
+        const char* filename, const char* mtl_basepath, bool triangulate, unsigned threadCount = 0);
+
+}
+
+#endif /* ObjLoader_hpp */
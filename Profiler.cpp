@@ -0,0 +1,226 @@
+#include "Profiler.hpp"
+
+#include "json.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+	const size_t Profiler::ringCapacity;
+
+	namespace {
+
+		struct ProfileEvent {
+
+			const char* name;
+			// Nanoseconds since the profiler's epoch
+			long long start;
+			long long duration;
+		};
+
+		// Written only by its own thread
+		struct ThreadEvents {
+
+			std::string name;
+			unsigned id;
+			std::vector<ProfileEvent> ring;
+			// Events recorded so far, the newest ringCapacity of them are kept
+			size_t count;
+
+			void record(const char* eventName, long long start, long long duration) {
+				ProfileEvent& event = ring[count % Profiler::ringCapacity];
+				event.name = eventName;
+				event.start = start;
+				event.duration = duration;
+				count++;
+			}
+		};
+
+		// A GPU zone whose query result has not been read yet
+		struct PendingQuery {
+
+			const char* name;
+			GLuint query;
+			long long cpuStart;
+		};
+	}
+
+	static std::atomic<bool> profilerEnabled(false);
+
+	static std::mutex threadsMutex;
+	static std::vector<std::unique_ptr<ThreadEvents> > threads;
+	static thread_local ThreadEvents* currentThread = NULL;
+
+	// GPU state, only touched by the GL thread
+	static ThreadEvents* gpuEvents = NULL;
+	static std::deque<PendingQuery> pendingQueries;
+	static std::vector<GLuint> freeQueries;
+	static bool gpuZoneOpen = false;
+
+	static long long now() {
+		static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	// Registration locks once per thread, recording never does
+	static ThreadEvents* addThread(const std::string& name) {
+
+		std::unique_ptr<ThreadEvents> events(new ThreadEvents());
+		events->name = name;
+		events->ring.resize(Profiler::ringCapacity);
+		events->count = 0;
+
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		events->id = (unsigned)threads.size() + 1;
+		threads.push_back(std::move(events));
+		return threads.back().get();
+	}
+
+	static ThreadEvents* getThreadEvents() {
+		if (!currentThread) {
+			currentThread = addThread("Thread");
+		}
+		return currentThread;
+	}
+
+	void Profiler::setEnabled(bool enabled) {
+		profilerEnabled = enabled;
+		// Starts the clock
+		now();
+	}
+
+	bool Profiler::isEnabled() {
+		return profilerEnabled;
+	}
+
+	void Profiler::setThreadName(const std::string& name) {
+
+		ThreadEvents* events = getThreadEvents();
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		events->name = name;
+	}
+
+	void Profiler::endFrame() {
+
+		// Queries finish in the order they were issued, so the first unfinished one ends the scan
+		while (!pendingQueries.empty()) {
+
+			PendingQuery& pending = pendingQueries.front();
+			GLint available = 0;
+			glGetQueryObjectiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				break;
+			}
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &elapsed);
+			// Placed at the time the commands were issued, the GPU runs them somewhat later
+			gpuEvents->record(pending.name, pending.cpuStart, (long long)elapsed);
+
+			freeQueries.push_back(pending.query);
+			pendingQueries.pop_front();
+		}
+	}
+
+	bool Profiler::WriteChromeTrace(const std::string& fileName) {
+
+		nlohmann::json events = nlohmann::json::array();
+
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		for (size_t t = 0; t < threads.size(); t++) {
+
+			const ThreadEvents& thread = *threads[t];
+
+			nlohmann::json threadName;
+			threadName["name"] = "thread_name";
+			threadName["ph"] = "M";
+			threadName["pid"] = 1;
+			threadName["tid"] = thread.id;
+			threadName["args"]["name"] = thread.name;
+			events.push_back(threadName);
+
+			size_t first = thread.count > ringCapacity ? thread.count - ringCapacity : 0;
+			for (size_t i = first; i < thread.count; i++) {
+
+				const ProfileEvent& event = thread.ring[i % ringCapacity];
+				nlohmann::json zone;
+				zone["name"] = event.name;
+				zone["ph"] = "X";
+				zone["pid"] = 1;
+				zone["tid"] = thread.id;
+				// Microseconds
+				zone["ts"] = event.start / 1000.0;
+				zone["dur"] = event.duration / 1000.0;
+				events.push_back(zone);
+			}
+		}
+
+		nlohmann::json trace;
+		trace["traceEvents"] = events;
+		trace["displayTimeUnit"] = "ms";
+
+		std::ofstream file(fileName.c_str());
+		if (!file) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			return false;
+		}
+		file << trace.dump();
+		return true;
+	}
+
+	ProfileScope::ProfileScope(const char* name) : name(NULL), start(0) {
+
+		if (profilerEnabled) {
+			this->name = name;
+			start = now();
+		}
+	}
+
+	ProfileScope::~ProfileScope() {
+
+		if (name) {
+			long long end = now();
+			getThreadEvents()->record(name, start, end - start);
+		}
+	}
+
+	GpuProfileScope::GpuProfileScope(const char* name) : active(false) {
+
+		if (!profilerEnabled || gpuZoneOpen) {
+			return;
+		}
+
+		if (!gpuEvents) {
+			gpuEvents = addThread("GPU");
+		}
+
+		GLuint query;
+		if (!freeQueries.empty()) {
+			query = freeQueries.back();
+			freeQueries.pop_back();
+		} else {
+			glGenQueries(1, &query);
+		}
+
+		PendingQuery pending = { name, query, now() };
+		pendingQueries.push_back(pending);
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		gpuZoneOpen = true;
+		active = true;
+	}
+
+	GpuProfileScope::~GpuProfileScope() {
+
+		if (active) {
+			glEndQuery(GL_TIME_ELAPSED);
+			gpuZoneOpen = false;
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef Profiler_hpp
+#define Profiler_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <string>
+
+namespace gps {
+
+    // Frame profiler. CPU zones go to a ring buffer of the thread that ran them, so recording takes
+    // no lock. GPU zones are timed with GL_TIME_ELAPSED queries, read back once the GPU is done
+    // with them, and a capture is exported as a Chrome trace (chrome://tracing, Perfetto).
+    class Profiler {
+
+    public:
+        // Zones cost a branch while disabled, it starts disabled
+        static void setEnabled(bool enabled);
+        static bool isEnabled();
+
+        // Names the calling thread's track in the trace
+        static void setThreadName(const std::string& name);
+
+        // Collects GPU zones whose results arrived, never waits for the GPU. GL thread only, once per frame.
+        static void endFrame();
+
+        // Writes the events still held by the rings. The threads recording them should be idle.
+        static bool WriteChromeTrace(const std::string& fileName);
+
+        // Events each thread keeps, older ones are overwritten
+        static const size_t ringCapacity = 1 << 16;
+    };
+
+    // Times the enclosing block on the calling thread
+    class ProfileScope {
+
+    public:
+        // name must outlive the profiler, a string literal
+        explicit ProfileScope(const char* name);
+        ~ProfileScope();
+
+    private:
+        const char* name;
+        long long start;
+
+        ProfileScope(const ProfileScope&);
+        ProfileScope& operator=(const ProfileScope&);
+    };
+
+    // Times the GL commands issued in the enclosing block. Time elapsed queries cannot nest,
+    // so a zone opened inside another one is skipped. GL thread only.
+    class GpuProfileScope {
+
+    public:
+        explicit GpuProfileScope(const char* name);
+        ~GpuProfileScope();
+
+    private:
+        bool active;
+
+        GpuProfileScope(const GpuProfileScope&);
+        GpuProfileScope& operator=(const GpuProfileScope&);
+    };
+}
+
+#endif /* Profiler_hpp */
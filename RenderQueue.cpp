@@ -0,0 +1,300 @@
+#include "RenderQueue.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+
+namespace gps {
+
+	// Key layout, most significant first: pass 2 bits, shader 10, material 20, depth 16, object 16
+	static const int passShift = 62;
+	static const int shaderShift = 52;
+	static const int materialShift = 32;
+	static const int depthShift = 16;
+	static const uint64_t shaderMask = (1u << 10) - 1;
+	static const uint64_t materialMask = (1u << 20) - 1;
+	static const uint64_t depthMask = (1u << 16) - 1;
+	static const uint64_t objectMask = (1u << 16) - 1;
+
+	typedef std::vector<std::pair<GLuint, std::string> > TextureSet;
+	static std::map<TextureSet, unsigned> materialKeys;
+
+	void RenderQueue::setDepthRange(float farPlane) {
+		depthRange = farPlane;
+	}
+
+	void RenderQueue::setStreamBuffer(StreamBuffer* stream) {
+		this->stream = stream;
+	}
+
+	unsigned RenderQueue::addObject(const ObjectUniforms& object) {
+		objects.push_back(object);
+		return (unsigned)objects.size() - 1;
+	}
+
+	void RenderQueue::push(RenderPass pass, const DrawItem& item, float depth) {
+
+		size_t shader = std::find(shaders.begin(), shaders.end(), item.shader) - shaders.begin();
+		if (shader == shaders.size()) {
+			shaders.push_back(item.shader);
+		}
+
+		// Transparent draws go back to front
+		float normalizedDepth = std::min(std::max(depth / depthRange, 0.0f), 1.0f);
+		if (pass == RenderPassTransparent) {
+			normalizedDepth = 1.0f - normalizedDepth;
+		}
+
+		SortEntry entry;
+		entry.key = ((uint64_t)pass << passShift)
+			| (((uint64_t)shader & shaderMask) << shaderShift)
+			| (((uint64_t)item.submesh->materialKey & materialMask) << materialShift)
+			| (((uint64_t)(normalizedDepth * depthMask) & depthMask) << depthShift)
+			| ((uint64_t)item.object & objectMask);
+		entry.item = (uint32_t)items.size();
+
+		items.push_back(item);
+		entries.push_back(entry);
+	}
+
+	void RenderQueue::Execute() {
+
+		ProfileScope zone("RenderQueue::Execute");
+		GpuProfileScope gpuZone("RenderQueue::Execute");
+		stats = RenderQueueStats();
+		stats.draws = entries.size();
+
+		RadixSort(entries, scratch);
+
+		// One upload for the uniforms of every object
+		size_t objectStride = (sizeof(ObjectUniforms) + UniformBuffer::getOffsetAlignment() - 1)
+			/ UniformBuffer::getOffsetAlignment() * UniformBuffer::getOffsetAlignment();
+		StreamAllocation objectAllocation = { 0, 0 };
+		if (!objects.empty()) {
+			objectData.resize(objects.size() * objectStride);
+			for (size_t i = 0; i < objects.size(); i++) {
+				memcpy(&objectData[i * objectStride], &objects[i], sizeof(ObjectUniforms));
+			}
+			if (stream) {
+				objectAllocation = stream->write(objectData.data(), objectData.size(), UniformBuffer::getOffsetAlignment());
+			} else {
+				objectBuffer.update(objectData.data(), objectData.size());
+				objectAllocation.buffer = objectBuffer.getBuffer();
+			}
+		}
+
+		const Shader* shader = NULL;
+		unsigned material = 0;
+		unsigned object = 0;
+		// Bounds the positions are decoded with, NULL for the identity range of float meshes
+		const Submesh* positionRange = NULL;
+		bool quantized = false;
+		const glm::mat4* nodeMatrix = NULL;
+		GLint quantizedLoc = -1, positionMinLoc = -1, positionExtentLoc = -1;
+		GLint nodeMatrixLoc = -1, nodeNormalMatrixLoc = -1;
+
+		// First draw of the batch, holding the state the whole batch shares
+		DrawItem pending;
+		bool hasPending = false;
+
+		for (size_t e = 0; e < entries.size(); e++) {
+
+			const DrawItem& item = items[entries[e].item];
+			const Submesh* range = item.quantized ? item.submesh : NULL;
+
+			bool shaderChange = item.shader != shader;
+			bool materialChange = shaderChange || item.submesh->materialKey != material;
+			bool objectChange = e == 0 || item.object != object;
+			bool rangeChange = shaderChange || item.quantized != quantized || range != positionRange;
+			bool nodeChange = shaderChange || *nodeMatrix != item.submesh->nodeMatrix;
+
+			// Same state, the range joins the batch
+			if (hasPending && !materialChange && !objectChange && !rangeChange && !nodeChange &&
+				item.VAO == pending.VAO && item.indexType == pending.indexType) {
+
+				AddToBatch(item);
+				continue;
+			}
+
+			if (hasPending) {
+				DrawBatch(pending);
+			}
+
+			if (shaderChange) {
+				shader = item.shader;
+				shader->useShaderProgram();
+				quantizedLoc = shader->getUniformLocation(UniformQuantizedVertices);
+				positionMinLoc = shader->getUniformLocation(UniformPositionMin);
+				positionExtentLoc = shader->getUniformLocation(UniformPositionExtent);
+				nodeMatrixLoc = shader->getUniformLocation(UniformNodeMatrix);
+				nodeNormalMatrixLoc = shader->getUniformLocation(UniformNodeNormalMatrix);
+				stats.shaderChanges++;
+			}
+
+			if (materialChange) {
+				material = item.submesh->materialKey;
+				const std::vector<Texture>& textures = item.submesh->textures;
+				for (GLuint i = 0; i < textures.size(); i++) {
+					glUniform1i(shader->getUniformLocation(textures[i].uniform), i);
+					GLState::bindTexture(i, textures[i].id);
+				}
+				GLState::unbindTextures((GLuint)textures.size());
+				stats.materialChanges++;
+			}
+
+			if (objectChange) {
+				object = item.object;
+				glBindBufferRange(GL_UNIFORM_BUFFER, ObjectBlockBinding, objectAllocation.buffer,
+					objectAllocation.offset + object * objectStride, sizeof(ObjectUniforms));
+				stats.objectChanges++;
+			}
+
+			if (rangeChange) {
+				if (shaderChange || item.quantized != quantized) {
+					glUniform1i(quantizedLoc, item.quantized);
+				}
+				quantized = item.quantized;
+				positionRange = range;
+				if (range) {
+					glm::vec3 extent = range->boundingBox.max - range->boundingBox.min;
+					glUniform3fv(positionMinLoc, 1, glm::value_ptr(range->boundingBox.min));
+					glUniform3fv(positionExtentLoc, 1, glm::value_ptr(extent));
+				} else {
+					glUniform3f(positionMinLoc, 0.0f, 0.0f, 0.0f);
+					glUniform3f(positionExtentLoc, 1.0f, 1.0f, 1.0f);
+				}
+			}
+
+			if (nodeChange) {
+				nodeMatrix = &item.submesh->nodeMatrix;
+				setNodeUniforms(nodeMatrixLoc, nodeNormalMatrixLoc, *nodeMatrix);
+			}
+
+			pending = item;
+			hasPending = true;
+			AddToBatch(item);
+		}
+
+		if (hasPending) {
+			DrawBatch(pending);
+		}
+	}
+
+	void RenderQueue::AddToBatch(const DrawItem& item) {
+
+		GLsizeiptr indexSize = item.indexType == GL_NONE ? 0 : getIndexSize(item.indexType);
+		const GLvoid* offset = (const GLvoid*)(item.firstIndex * indexSize);
+
+		if (!batchCounts.empty()) {
+
+			bool follows = item.indexType == GL_NONE
+				? item.baseVertex == batchBaseVertices.back() + batchCounts.back()
+				: item.baseVertex == batchBaseVertices.back() &&
+					offset == (const char*)batchOffsets.back() + batchCounts.back() * indexSize;
+			if (follows) {
+				batchCounts.back() += item.indexCount;
+				return;
+			}
+		}
+
+		batchCounts.push_back(item.indexCount);
+		batchOffsets.push_back(offset);
+		batchBaseVertices.push_back(item.baseVertex);
+	}
+
+	void RenderQueue::DrawBatch(const DrawItem& state) {
+
+		GLState::bindVertexArray(state.VAO);
+		GLsizei rangeCount = (GLsizei)batchCounts.size();
+		if (state.indexType == GL_NONE) {
+			glMultiDrawArrays(GL_TRIANGLES, batchBaseVertices.data(), batchCounts.data(), rangeCount);
+		} else {
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, batchCounts.data(), state.indexType, batchOffsets.data(),
+				rangeCount, batchBaseVertices.data());
+		}
+
+		GLsizei indexCount = 0;
+		for (GLsizei r = 0; r < rangeCount; r++) {
+			indexCount += batchCounts[r];
+		}
+		GLState::recordDraw(indexCount);
+		stats.drawCalls++;
+
+		batchCounts.clear();
+		batchOffsets.clear();
+		batchBaseVertices.clear();
+	}
+
+	void RenderQueue::clear() {
+
+		items.clear();
+		entries.clear();
+		objects.clear();
+		shaders.clear();
+	}
+
+	void RenderQueue::destroy() {
+		objectBuffer.destroy();
+	}
+
+	RenderQueueStats RenderQueue::getStats() const {
+		return stats;
+	}
+
+	unsigned RenderQueue::getMaterialKey(const std::vector<Texture>& textures) {
+
+		if (textures.empty()) {
+			return 0;
+		}
+
+		TextureSet set;
+		for (size_t i = 0; i < textures.size(); i++) {
+			set.push_back(std::make_pair(textures[i].id, textures[i].type));
+		}
+
+		std::map<TextureSet, unsigned>::iterator found = materialKeys.find(set);
+		if (found != materialKeys.end()) {
+			return found->second;
+		}
+
+		unsigned key = (unsigned)materialKeys.size() + 1;
+		materialKeys[set] = key;
+		return key;
+	}
+
+	void RenderQueue::RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch) {
+
+		scratch.resize(entries.size());
+
+		for (int shift = 0; shift < 64; shift += 8) {
+
+			size_t counts[256] = { 0 };
+			for (size_t i = 0; i < entries.size(); i++) {
+				counts[(entries[i].key >> shift) & 0xff]++;
+			}
+
+			// Every key has the same digit here, the order wouldn't change
+			if (entries.empty() || counts[(entries[0].key >> shift) & 0xff] == entries.size()) {
+				continue;
+			}
+
+			size_t offset = 0;
+			for (int digit = 0; digit < 256; digit++) {
+				size_t count = counts[digit];
+				counts[digit] = offset;
+				offset += count;
+			}
+
+			for (size_t i = 0; i < entries.size(); i++) {
+				scratch[counts[(entries[i].key >> shift) & 0xff]++] = entries[i];
+			}
+			entries.swap(scratch);
+		}
+	}
+}
@@ -0,0 +1,114 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include "Mesh.hpp"
+#include "Shader.hpp"
+#include "UniformBuffer.hpp"
+#include "StreamBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Passes run in this order, opaque draws front to back and transparent ones back to front
+    enum RenderPass {
+
+        RenderPassOpaque = 0,
+        RenderPassTransparent = 1
+    };
+
+    // One index range to draw with the state of its submesh
+    struct DrawItem {
+
+        const Shader* shader;
+        // Textures, material key and quantization bounds
+        const Submesh* submesh;
+        GLuint VAO;
+        GLenum indexType;
+        GLuint firstIndex;
+        GLsizei indexCount;
+        GLint baseVertex;
+        bool quantized;
+        unsigned object;
+    };
+
+    // What the last Execute did
+    struct RenderQueueStats {
+
+        size_t draws;
+        // Multi-draw calls, each drawing every range of a run of draws with the same state
+        size_t drawCalls;
+        size_t shaderChanges;
+        size_t materialChanges;
+        size_t objectChanges;
+    };
+
+    // Collects the draws of a frame, sorts them by a 64 bit key (pass, shader, material, depth, object)
+    // and executes them in that order, setting each piece of state only when it changes and
+    // drawing each run of draws with the same state through one glMultiDraw* call
+    class RenderQueue {
+
+    public:
+        // Objects further than this share the last depth bucket
+        void setDepthRange(float farPlane);
+
+        // Streams the object uniforms through the ring instead of a buffer of the queue's own
+        void setStreamBuffer(StreamBuffer* stream);
+
+        // Returns the index the draws of the object are submitted with. The uniforms of all
+        // the objects go to one buffer, and each draw binds its own range as ObjectUniforms.
+        unsigned addObject(const ObjectUniforms& object);
+
+        // depth is the view space distance of the draw from the camera
+        void push(RenderPass pass, const DrawItem& item, float depth);
+
+        void Execute();
+
+        // Drops the draws and objects of the frame
+        void clear();
+
+        // Deletes the GL buffers of the queue, call before the context goes away
+        void destroy();
+
+        RenderQueueStats getStats() const;
+
+        // Small id shared by every submesh with the same textures, 0 for none
+        static unsigned getMaterialKey(const std::vector<Texture>& textures);
+
+    private:
+        struct SortEntry {
+
+            uint64_t key;
+            uint32_t item;
+        };
+
+        std::vector<DrawItem> items;
+        std::vector<SortEntry> entries;
+        std::vector<SortEntry> scratch;
+        std::vector<ObjectUniforms> objects;
+        // Objects at multiples of the offset alignment
+        std::vector<unsigned char> objectData;
+        UniformBuffer objectBuffer;
+        StreamBuffer* stream = NULL;
+        // Shaders seen this frame, their index goes into the key
+        std::vector<const Shader*> shaders;
+        float depthRange = 1000.0f;
+        RenderQueueStats stats = RenderQueueStats();
+        // Ranges of the batch Execute is gathering, the base vertices are the first vertices of glMultiDrawArrays
+        std::vector<GLsizei> batchCounts;
+        std::vector<const GLvoid*> batchOffsets;
+        std::vector<GLint> batchBaseVertices;
+
+        // Least significant digit first, 8 bits per pass, skipping digits all keys share
+        static void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+
+        // Adds the range of the item to the batch, joining it to the last range when it follows on
+        void AddToBatch(const DrawItem& item);
+        void DrawBatch(const DrawItem& state);
+    };
+}
+
+#endif /* RenderQueue_hpp */
@@ -0,0 +1,55 @@
+#include "SceneSnapshot.hpp"
+#include "Profiler.hpp"
+
+#include <utility>
+
+namespace gps {
+
+	SnapshotBuffer::SnapshotBuffer() : writeIndex(0), readyIndex(1), readIndex(2), fresh(false), closed(false) {
+	}
+
+	SceneSnapshot& SnapshotBuffer::getWriteSnapshot() {
+		return snapshots[writeIndex];
+	}
+
+	void SnapshotBuffer::publish() {
+
+		// Time spent waiting for the render thread
+		ProfileScope zone("SnapshotBuffer::publish");
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this]() { return !fresh || closed; });
+
+		// Only indices move, the snapshots and their vectors stay where they are
+		std::swap(writeIndex, readyIndex);
+		fresh = true;
+		changed.notify_all();
+	}
+
+	bool SnapshotBuffer::acquire() {
+
+		// Time spent waiting for the simulation
+		ProfileScope zone("SnapshotBuffer::acquire");
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this]() { return fresh || closed; });
+		// The last published snapshot is still drawn after close()
+		if (!fresh) {
+			return false;
+		}
+
+		std::swap(readIndex, readyIndex);
+		fresh = false;
+		changed.notify_all();
+		return true;
+	}
+
+	const SceneSnapshot& SnapshotBuffer::getReadSnapshot() const {
+		return snapshots[readIndex];
+	}
+
+	void SnapshotBuffer::close() {
+
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		changed.notify_all();
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef SceneSnapshot_hpp
+#define SceneSnapshot_hpp
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    // Placement of one drawn object
+    struct SnapshotObject {
+
+        glm::mat4 model;
+        // Inverse transpose of the model matrix
+        glm::mat3 normalMatrix;
+    };
+
+    // Everything the render thread needs for one frame. The simulation fills it in and
+    // never touches it again once published, so the renderer reads it without locking.
+    struct SceneSnapshot {
+
+        glm::mat4 view;
+        glm::mat4 projection;
+        int viewportWidth = 0;
+        int viewportHeight = 0;
+        // World space, w unused
+        glm::vec3 lightDir;
+        glm::vec3 lightColor;
+        glm::vec3 lightPos;
+        // Indexed the way the renderer lists its models
+        std::vector<SnapshotObject> objects;
+        // Model matrices of the instanced airplanes, in the simulation's order
+        std::vector<glm::mat4> instances;
+        // Stable key of each instanced airplane, the renderer keeps one instance per key
+        std::vector<unsigned> instanceKeys;
+        unsigned long long frame = 0;
+    };
+
+    // Three snapshots rotating between the simulation, the render thread and a hand-off slot.
+    // The simulation can build the next frame while the previous one is being drawn.
+    class SnapshotBuffer {
+
+    public:
+        SnapshotBuffer();
+
+        // The snapshot to fill in, owned by the simulation until publish()
+        SceneSnapshot& getWriteSnapshot();
+
+        // Hands the written snapshot to the render thread. Waits while the previous one has not
+        // been acquired, so the simulation stays at most a frame ahead of the renderer.
+        void publish();
+
+        // Waits for a snapshot newer than the last acquired one. Returns false once closed
+        // and every published snapshot was acquired.
+        bool acquire();
+
+        // The last acquired snapshot, owned by the render thread until the next acquire()
+        const SceneSnapshot& getReadSnapshot() const;
+
+        // Wakes both threads, acquire() stops waiting for new snapshots
+        void close();
+
+    private:
+        SceneSnapshot snapshots[3];
+        unsigned writeIndex;
+        unsigned readyIndex;
+        unsigned readIndex;
+        // The ready slot holds a snapshot not acquired yet
+        bool fresh;
+        bool closed;
+        std::mutex mutex;
+        std::condition_variable changed;
+
+        SnapshotBuffer(const SnapshotBuffer&);
+        SnapshotBuffer& operator=(const SnapshotBuffer&);
+    };
+}
+
+#endif /* SceneSnapshot_hpp */
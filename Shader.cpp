@@ -7,8 +7,24 @@
 //
 
 #include "Shader.hpp"
+#include "GLState.hpp"
 
 namespace gps {
+
+    static unsigned nameLookupCount = 0;
+
+    //uniform names of the slots, in UniformSlot order
+    static const char* const slotNames[UniformSlotCount] = {
+        "positionMin",
+        "positionExtent",
+        "quantizedVertices",
+        "nodeMatrix",
+        "nodeNormalMatrix",
+        "ambientTexture",
+        "diffuseTexture",
+        "specularTexture"
+    };
+
     std::string Shader::readShaderFile(std::string fileName) {
 
         std::ifstream shaderFile;
@@ -89,11 +105,86 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+        reflectUniforms();
+    }
+
+    void Shader::reflectUniforms() {
+
+        uniformLocations.clear();
+
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        std::string name(maxNameLength > 0 ? maxNameLength : 1, '\0');
+        for (GLint i = 0; i < uniformCount; i++) {
+
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniformName = name.substr(0, length);
+
+            //uniform block members have no location
+            GLint location = glGetUniformLocation(this->shaderProgram, uniformName.c_str());
+            if (location == -1) {
+                continue;
+            }
+
+            uniformLocations[uniformName] = location;
+            //arrays are reported as "name[0]", also answer to the plain name
+            size_t bracket = uniformName.find('[');
+            if (bracket != std::string::npos) {
+                uniformLocations[uniformName.substr(0, bracket)] = location;
+            }
+        }
+
+        for (int slot = 0; slot < UniformSlotCount; slot++) {
+
+            std::unordered_map<std::string, GLint>::const_iterator found = uniformLocations.find(slotNames[slot]);
+            slotLocations[slot] = found != uniformLocations.end() ? found->second : -1;
+        }
+    }
+
+    GLint Shader::getUniformLocation(const std::string& name) const {
+
+        nameLookupCount++;
+        std::unordered_map<std::string, GLint>::const_iterator found = uniformLocations.find(name);
+        return found != uniformLocations.end() ? found->second : -1;
+    }
+
+    GLint Shader::getUniformLocation(UniformSlot slot) const {
+
+        return slot < UniformSlotCount ? slotLocations[slot] : -1;
+    }
+
+    UniformSlot Shader::getTextureSlot(const std::string& type) {
+
+        for (int slot = UniformAmbientTexture; slot <= UniformSpecularTexture; slot++) {
+            if (type == slotNames[slot]) {
+                return (UniformSlot)slot;
+            }
+        }
+        return UniformSlotCount;
+    }
+
+    void Shader::bindUniformBlock(const std::string& blockName, GLuint binding) const {
+
+        GLuint blockIndex = glGetUniformBlockIndex(this->shaderProgram, blockName.c_str());
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(this->shaderProgram, blockIndex, binding);
+        }
+    }
+
+    unsigned Shader::getNameLookupCount() {
+
+        return nameLookupCount;
     }
     
-    void Shader::useShaderProgram() {
+    void Shader::useShaderProgram() const {
 
-        glUseProgram(this->shaderProgram);
+        GLState::useProgram(this->shaderProgram);
     }
 
 }
@@ -20,19 +20,47 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <unordered_map>
 
 
 namespace gps {
+
+    //uniforms set for every draw, resolved once after linking so drawing needs no name lookup
+    enum UniformSlot {
+        UniformPositionMin,
+        UniformPositionExtent,
+        UniformQuantizedVertices,
+        UniformNodeMatrix,
+        UniformNodeNormalMatrix,
+        UniformAmbientTexture,
+        UniformDiffuseTexture,
+        UniformSpecularTexture,
+        UniformSlotCount
+    };
     
     class Shader {
 
     public:
         GLuint shaderProgram;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-        void useShaderProgram();
+        void useShaderProgram() const;
+        //location of an active uniform, from the table built after linking; -1 if the program doesn't use it
+        GLint getUniformLocation(const std::string& name) const;
+        //location of a per-draw uniform, -1 if the program doesn't use it
+        GLint getUniformLocation(UniformSlot slot) const;
+        //connects a uniform block to a binding point, blocks the program doesn't use are ignored
+        void bindUniformBlock(const std::string& blockName, GLuint binding) const;
+        //slot of a texture uniform by its type, UniformSlotCount for types no shader samples
+        static UniformSlot getTextureSlot(const std::string& type);
+        //getUniformLocation(name) calls made by all shaders, none are expected once rendering starts
+        static unsigned getNameLookupCount();
     
     private:
+        std::unordered_map<std::string, GLint> uniformLocations;
+        GLint slotLocations[UniformSlotCount];
         std::string readShaderFile(std::string fileName);
+        void reflectUniforms();
         void shaderCompileLog(GLuint shaderId);
         void shaderLinkLog(GLuint shaderProgramId);
     };
@@ -0,0 +1,200 @@
+#include "StreamBuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+	// Region sizes stay a multiple of this, so every region starts aligned for any binding
+	static const size_t regionAlignment = 256;
+
+	static size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	StreamBuffer::StreamBuffer() : buffer(0), mapped(NULL), frameSize(0), frame(0), head(0),
+		persistent(false), frameStarted(false), stallCount(0) {
+
+		for (unsigned i = 0; i < frameCount; i++) {
+			fences[i] = 0;
+		}
+	}
+
+	StreamBuffer::~StreamBuffer() {
+		destroy();
+	}
+
+	void StreamBuffer::destroy() {
+
+		for (unsigned i = 0; i < frameCount; i++) {
+			if (fences[i]) {
+				glDeleteSync(fences[i]);
+				fences[i] = 0;
+			}
+		}
+		for (size_t i = 0; i < retiredBuffers.size(); i++) {
+			if (retiredFences[i]) {
+				glDeleteSync(retiredFences[i]);
+			}
+			glDeleteBuffers(1, &retiredBuffers[i]);
+		}
+		retiredBuffers.clear();
+		retiredFences.clear();
+		if (buffer) {
+			// Deleting a mapped buffer unmaps it
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+			mapped = NULL;
+		}
+	}
+
+	void StreamBuffer::init(size_t frameSize) {
+
+		this->frameSize = alignUp(frameSize, regionAlignment);
+#if defined (__APPLE__)
+		persistent = false;
+#else
+		persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+#endif
+		createBuffer();
+	}
+
+	void StreamBuffer::createBuffer() {
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		mapped = NULL;
+
+#if !defined (__APPLE__)
+		if (persistent) {
+			// Coherent, so writes are visible to the GPU without explicit flushes
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * frameCount, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * frameCount, flags);
+			if (mapped) {
+				return;
+			}
+
+			// Immutable storage can't be resized into a regular buffer, start over
+			std::cout << "Persistent mapping failed, streaming through orphaned buffers" << std::endl;
+			persistent = false;
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		}
+#endif
+
+		// One region, orphaned every frame
+		glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+	}
+
+	void StreamBuffer::beginFrame() {
+
+		head = 0;
+		frameStarted = true;
+
+		if (!persistent) {
+			// The driver hands out fresh storage while the GPU still reads the old one
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, frameSize, NULL, GL_STREAM_DRAW);
+			return;
+		}
+
+		if (!fences[frame]) {
+			return;
+		}
+
+		// The GPU is normally frameCount - 1 frames ahead of needing this region again
+		GLenum result = glClientWaitSync(fences[frame], 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			stallCount++;
+			do {
+				result = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fences[frame]);
+		fences[frame] = 0;
+	}
+
+	StreamAllocation StreamBuffer::write(const void* data, size_t size, size_t alignment) {
+
+		if (!frameStarted) {
+			beginFrame();
+		}
+
+		size_t offset = alignUp(head, alignment);
+		if (offset + size > frameSize) {
+
+			std::cout << "Stream buffer frame of " << frameSize << " bytes is full, growing it" << std::endl;
+
+			// Earlier writes of this frame may still be bound, the buffer goes once the GPU is done with it
+			retiredBuffers.push_back(buffer);
+			retiredFences.push_back(0);
+			for (unsigned i = 0; i < frameCount; i++) {
+				if (fences[i]) {
+					glDeleteSync(fences[i]);
+					fences[i] = 0;
+				}
+			}
+
+			frameSize = alignUp(std::max(frameSize * 2, size + alignment), regionAlignment);
+			frame = 0;
+			createBuffer();
+			beginFrame();
+			offset = 0;
+		}
+
+		size_t base = persistent ? frame * frameSize : 0;
+		if (persistent) {
+			memcpy(mapped + base + offset, data, size);
+		} else {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, base + offset, size, data);
+		}
+		head = offset + size;
+
+		StreamAllocation allocation;
+		allocation.buffer = buffer;
+		allocation.offset = base + offset;
+		return allocation;
+	}
+
+	void StreamBuffer::endFrame() {
+
+		if (persistent && frameStarted) {
+			fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		// Retired buffers get a fence after their last frame, and go once it has passed
+		for (size_t i = 0; i < retiredBuffers.size(); ) {
+
+			if (!retiredFences[i]) {
+				retiredFences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				i++;
+				continue;
+			}
+
+			GLenum result = glClientWaitSync(retiredFences[i], 0, 0);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+				glDeleteSync(retiredFences[i]);
+				glDeleteBuffers(1, &retiredBuffers[i]);
+				retiredFences.erase(retiredFences.begin() + i);
+				retiredBuffers.erase(retiredBuffers.begin() + i);
+			} else {
+				i++;
+			}
+		}
+
+		frame = (frame + 1) % frameCount;
+		frameStarted = false;
+	}
+
+	bool StreamBuffer::isPersistent() const {
+		return persistent;
+	}
+
+	size_t StreamBuffer::getStallCount() const {
+		return stallCount;
+	}
+}
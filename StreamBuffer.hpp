@@ -0,0 +1,80 @@
+#ifndef StreamBuffer_hpp
+#define StreamBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Where a write landed, to bind as a buffer range or point attributes at
+    struct StreamAllocation {
+
+        GLuint buffer;
+        size_t offset;
+    };
+
+    // Ring of per-frame regions in one large buffer for data rewritten every frame (uniforms,
+    // instance data). With ARB_buffer_storage the buffer stays persistently mapped and a fence
+    // per region makes sure the GPU is done with it before it is written again; without it the
+    // buffer is orphaned every frame instead.
+    class StreamBuffer {
+
+    public:
+        static const unsigned frameCount = 3;
+
+        StreamBuffer();
+        ~StreamBuffer();
+
+        // Allocates frameCount regions of frameSize bytes. Must be called from the GL thread.
+        void init(size_t frameSize);
+
+        // Deletes the buffers and fences while the context is still current, the destructor then
+        // has nothing left to do
+        void destroy();
+
+        // Copies size bytes into the region of the current frame, at a multiple of alignment.
+        // A frame that runs out of space moves to a buffer twice as large.
+        StreamAllocation write(const void* data, size_t size, size_t alignment);
+
+        // Call once all the draws of the frame are issued: fences the region and moves to the next one
+        void endFrame();
+
+        bool isPersistent() const;
+
+        // Times write had to wait for the GPU to release a region
+        size_t getStallCount() const;
+
+    private:
+        GLuint buffer;
+        unsigned char* mapped;
+        size_t frameSize;
+        unsigned frame;
+        size_t head;
+        bool persistent;
+        bool frameStarted;
+        GLsync fences[frameCount];
+        size_t stallCount;
+
+        // Buffers replaced by a larger one, deleted once the GPU is past retiredFences
+        std::vector<GLuint> retiredBuffers;
+        std::vector<GLsync> retiredFences;
+
+        void createBuffer();
+
+        // Waits for the fence of the current region, or orphans the buffer when not persistent
+        void beginFrame();
+
+        StreamBuffer(const StreamBuffer&);
+        StreamBuffer& operator=(const StreamBuffer&);
+    };
+}
+
+#endif /* StreamBuffer_hpp */
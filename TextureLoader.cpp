@@ -0,0 +1,140 @@
+#include "TextureLoader.hpp"
+#include "GLState.hpp"
+
+#include "stb_image.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace gps {
+
+	TextureImage DecodeImage(const std::string& fileName) {
+
+		TextureImage image;
+		image.path = fileName;
+		image.width = 0;
+		image.height = 0;
+
+		int x, y, n;
+		int force_channels = 4;
+		unsigned char* image_data = stbi_load(fileName.c_str(), &x, &y, &n, force_channels);
+		image.pixels = image_data;
+
+		if (!image_data) {
+			fprintf(stderr, "ERROR: could not load %s\n", fileName.c_str());
+			return image;
+		}
+		// NPOT check
+		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+			fprintf(
+				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", fileName.c_str()
+			);
+		}
+
+		image.width = x;
+		image.height = y;
+
+		return image;
+	}
+
+	void FlipImageRows(TextureImage& image) {
+
+		if (!image.pixels) {
+			return;
+		}
+
+		int width_in_bytes = image.width * 4;
+		unsigned char *top = NULL;
+		unsigned char *bottom = NULL;
+		unsigned char temp = 0;
+		int half_height = image.height / 2;
+
+		for (int row = 0; row < half_height; row++) {
+
+			top = image.pixels + row * width_in_bytes;
+			bottom = image.pixels + (image.height - row - 1) * width_in_bytes;
+
+			for (int col = 0; col < width_in_bytes; col++) {
+
+				temp = *top;
+				*top = *bottom;
+				*bottom = temp;
+				top++;
+				bottom++;
+			}
+		}
+	}
+
+	TextureImage DecodeTexture(const std::string& fileName) {
+
+		TextureImage image = DecodeImage(fileName);
+		FlipImageRows(image);
+		return image;
+	}
+
+	GLuint UploadTexture(const TextureImage& image) {
+
+		if (!image.pixels) {
+			return 0;
+		}
+
+		GLuint textureID;
+		glGenTextures(1, &textureID);
+		GLState::bindTexture(0, textureID);
+		glTexImage2D(
+			GL_TEXTURE_2D,
+			0,
+			GL_SRGB, //GL_SRGB,//GL_RGBA,
+			image.width,
+			image.height,
+			0,
+			GL_RGBA,
+			GL_UNSIGNED_BYTE,
+			image.pixels
+		);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		GLState::bindTexture(0, 0);
+
+		return textureID;
+	}
+
+	void FreeImage(TextureImage& image) {
+
+		stbi_image_free(image.pixels);
+		image.pixels = NULL;
+	}
+
+	uint64_t HashImage(const TextureImage& image) {
+
+		const uint64_t prime = 0x100000001b3ull;
+		uint64_t hash = 0xcbf29ce484222325ull;
+		hash = (hash ^ (uint64_t)image.width) * prime;
+		hash = (hash ^ (uint64_t)image.height) * prime;
+
+		size_t size = image.pixels ? (size_t)image.width * image.height * 4 : 0;
+
+		// FNV-1a over 8 byte words rather than bytes; the shift folds the high bits back down,
+		// the multiply alone only carries bits upwards
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			uint64_t word;
+			memcpy(&word, image.pixels + i, 8);
+			hash = (hash ^ word) * prime;
+			hash ^= hash >> 32;
+		}
+		for (; i < size; i++) {
+			hash = (hash ^ image.pixels[i]) * prime;
+		}
+
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+
+		return hash != 0 ? hash : 1;
+	}
+}
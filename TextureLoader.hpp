@@ -0,0 +1,46 @@
+#ifndef TextureLoader_hpp
+#define TextureLoader_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Decoded RGBA pixels of a texture
+    struct TextureImage {
+
+        std::string path;
+        int width;
+        int height;
+        unsigned char* pixels; // stb_image allocation, NULL if the file could not be read
+        uint64_t contentHash = 0; // HashImage of the pixels, 0 until hashed
+    };
+
+    // Reads an image file as RGBA, the rows in file order (top first)
+    TextureImage DecodeImage(const std::string& fileName);
+
+    // Reverses the row order, OpenGL reads the bottom row first
+    void FlipImageRows(TextureImage& image);
+
+    // Reads the pixel data from an image file and flips it for OpenGL
+    TextureImage DecodeTexture(const std::string& fileName);
+
+    // Loads decoded pixel data into the video memory as a mipmapped sRGB texture,
+    // 0 if the image has no pixels. GL thread only.
+    GLuint UploadTexture(const TextureImage& image);
+
+    void FreeImage(TextureImage& image);
+
+    // 64 bit hash of the size and pixels, never 0. Equal images hash equal whatever file they came from.
+    uint64_t HashImage(const TextureImage& image);
+}
+
+#endif /* TextureLoader_hpp */
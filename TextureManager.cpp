@@ -0,0 +1,252 @@
+#include "TextureManager.hpp"
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace gps {
+
+	namespace {
+
+		struct TextureEntry {
+
+			GLuint id;
+			uint64_t hash;
+			// Canonical paths the texture was loaded from, several when their pixels are equal
+			std::vector<std::string> paths;
+			// 0 = free slot
+			unsigned references;
+		};
+
+		struct TextureRegistry {
+
+			std::mutex mutex;
+			// Handle h is entries[h - 1]
+			std::vector<TextureEntry> entries;
+			std::vector<TextureHandle> freeHandles;
+			std::unordered_map<std::string, TextureHandle> byPath;
+			std::unordered_map<uint64_t, TextureHandle> byHash;
+			// Canonical paths a loader is decoding and hasn't uploaded yet
+			std::unordered_set<std::string> decoding;
+			TextureManagerStats stats = { 0, 0, 0, 0, 0 };
+		};
+	}
+
+	// Never destroyed: models are globals too, and may release their textures after the
+	// statics of this file would be gone
+	static TextureRegistry& getRegistry() {
+
+		static TextureRegistry* registry = new TextureRegistry();
+		return *registry;
+	}
+
+	// Resolves "." and ".." and unifies separators without touching the file system
+	static std::string tidyPath(const std::string& path) {
+
+		std::vector<std::string> parts;
+		size_t start = 0;
+		while (start <= path.size()) {
+
+			size_t end = path.find_first_of("/\\", start);
+			if (end == std::string::npos) {
+				end = path.size();
+			}
+
+			std::string part = path.substr(start, end - start);
+			if (part == "..") {
+				if (!parts.empty() && parts.back() != ".." && !parts.back().empty()) {
+					parts.pop_back();
+				} else {
+					parts.push_back(part);
+				}
+			} else if (part != "." && (!part.empty() || parts.empty())) {
+				// An empty first part keeps an absolute path absolute
+				parts.push_back(part);
+			}
+			start = end + 1;
+		}
+
+		std::string tidy;
+		for (size_t i = 0; i < parts.size(); i++) {
+			tidy += (i > 0 ? "/" : "") + parts[i];
+		}
+		return tidy;
+	}
+
+	std::string TextureManager::getCanonicalPath(const std::string& path) {
+
+#if defined (_WIN32)
+		char resolved[_MAX_PATH];
+		if (_fullpath(resolved, path.c_str(), _MAX_PATH)) {
+			// Windows paths ignore case
+			std::string canonical = tidyPath(resolved);
+			std::transform(canonical.begin(), canonical.end(), canonical.begin(), ::tolower);
+			return canonical;
+		}
+#else
+		char* resolved = realpath(path.c_str(), NULL);
+		if (resolved) {
+			std::string canonical = resolved;
+			free(resolved);
+			return canonical;
+		}
+#endif
+		return tidyPath(path);
+	}
+
+	TextureHandle TextureManager::acquire(const std::string& path, bool& decode) {
+
+		std::string canonical = getCanonicalPath(path);
+		TextureRegistry& registry = getRegistry();
+
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		std::unordered_map<std::string, TextureHandle>::iterator found = registry.byPath.find(canonical);
+		if (found == registry.byPath.end()) {
+			// Only the first loader to miss decodes it, the others wait for its upload
+			decode = registry.decoding.insert(canonical).second;
+			return 0;
+		}
+
+		registry.entries[found->second - 1].references++;
+		registry.stats.pathHits++;
+		decode = false;
+		return found->second;
+	}
+
+	TextureHandle TextureManager::acquire(const TextureImage& image) {
+
+		std::string canonical = getCanonicalPath(image.path);
+		uint64_t hash = image.pixels && !image.contentHash ? HashImage(image) : image.contentHash;
+		TextureRegistry& registry = getRegistry();
+
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.decoding.erase(canonical);
+
+		if (!image.pixels) {
+			return 0;
+		}
+
+		std::unordered_map<std::string, TextureHandle>::iterator foundPath = registry.byPath.find(canonical);
+		if (foundPath != registry.byPath.end()) {
+
+			registry.entries[foundPath->second - 1].references++;
+			registry.stats.pathHits++;
+			return foundPath->second;
+		}
+
+		// Same pixels from another file, the path becomes another name of that texture
+		std::unordered_map<uint64_t, TextureHandle>::iterator foundHash = registry.byHash.find(hash);
+		if (foundHash != registry.byHash.end()) {
+
+			TextureEntry& entry = registry.entries[foundHash->second - 1];
+			entry.paths.push_back(canonical);
+			entry.references++;
+			registry.byPath[canonical] = foundHash->second;
+			registry.stats.hashHits++;
+			return foundHash->second;
+		}
+
+		TextureHandle handle;
+		if (!registry.freeHandles.empty()) {
+			handle = registry.freeHandles.back();
+			registry.freeHandles.pop_back();
+		} else {
+			registry.entries.push_back(TextureEntry());
+			handle = (TextureHandle)registry.entries.size();
+		}
+
+		// Only the GL thread creates textures, nothing else can add this path meanwhile
+		TextureEntry& entry = registry.entries[handle - 1];
+		entry.id = UploadTexture(image);
+		entry.hash = hash;
+		entry.paths.assign(1, canonical);
+		entry.references = 1;
+
+		registry.byPath[canonical] = handle;
+		registry.byHash[hash] = handle;
+		registry.stats.textures++;
+		registry.stats.uploads++;
+		return handle;
+	}
+
+	void TextureManager::abandon(const std::string& path) {
+
+		std::string canonical = getCanonicalPath(path);
+		TextureRegistry& registry = getRegistry();
+
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.decoding.erase(canonical);
+	}
+
+	void TextureManager::release(TextureHandle handle) {
+
+		if (handle == 0) {
+			return;
+		}
+
+		TextureRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		TextureEntry& entry = registry.entries[handle - 1];
+		if (entry.references == 0 || --entry.references > 0) {
+			return;
+		}
+
+		for (size_t i = 0; i < entry.paths.size(); i++) {
+			registry.byPath.erase(entry.paths[i]);
+		}
+		registry.byHash.erase(entry.hash);
+
+		GLState::forgetTexture(entry.id);
+		glDeleteTextures(1, &entry.id);
+
+		entry.id = 0;
+		entry.paths.clear();
+		registry.freeHandles.push_back(handle);
+		registry.stats.textures--;
+		registry.stats.frees++;
+	}
+
+	GLuint TextureManager::getTextureId(TextureHandle handle) {
+
+		if (handle == 0) {
+			return 0;
+		}
+
+		TextureRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		return registry.entries[handle - 1].id;
+	}
+
+	GLuint TextureManager::findTextureId(const std::string& path) {
+
+		std::string canonical = getCanonicalPath(path);
+		TextureRegistry& registry = getRegistry();
+
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		std::unordered_map<std::string, TextureHandle>::iterator found = registry.byPath.find(canonical);
+		return found != registry.byPath.end() ? registry.entries[found->second - 1].id : 0;
+	}
+
+	unsigned TextureManager::getReferenceCount(TextureHandle handle) {
+
+		if (handle == 0) {
+			return 0;
+		}
+
+		TextureRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		return registry.entries[handle - 1].references;
+	}
+
+	TextureManagerStats TextureManager::getStats() {
+
+		TextureRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		return registry.stats;
+	}
+}
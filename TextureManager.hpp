@@ -0,0 +1,63 @@
+#ifndef TextureManager_hpp
+#define TextureManager_hpp
+
+#include "TextureLoader.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Refers to a texture held by the TextureManager, 0 = none
+    typedef unsigned TextureHandle;
+
+    // Textures held by the TextureManager, and how acquire() found or created them
+    struct TextureManagerStats {
+
+        size_t textures;
+        size_t uploads;
+        size_t pathHits;
+        size_t hashHits;
+        size_t frees;
+    };
+
+    // Process-wide texture cache shared by every model. A texture is found by its canonical path,
+    // or by a hash of its pixels when the same image comes from another file, and is deleted
+    // once the last reference to it is released. The lookups lock, so paths can be acquired from
+    // loader threads; creating and deleting textures happens on the GL thread.
+    class TextureManager {
+
+    public:
+        // Adds a reference to the texture already loaded from path, 0 if there is none. On a miss
+        // decode tells whether the caller is the first loader to ask for the path and decodes it,
+        // handing the image to acquire(image) or the path to abandon(); otherwise another loader
+        // is decoding it and the path can be acquired again once that one is uploaded.
+        static TextureHandle acquire(const std::string& path, bool& decode);
+
+        // Adds a reference to the texture with the path or the pixels of image, uploading it
+        // when there is none. 0 if the image has no pixels. GL thread only.
+        static TextureHandle acquire(const TextureImage& image);
+
+        // Gives up the decode of path acquire(path, decode) gave the caller, without uploading it
+        static void abandon(const std::string& path);
+
+        // Drops a reference, deleting the texture with the last one. GL thread only.
+        static void release(TextureHandle handle);
+
+        // Texture name of a handle this caller holds a reference to, 0 for none
+        static GLuint getTextureId(TextureHandle handle);
+
+        // Texture name loaded from path, without adding a reference, 0 if there is none
+        static GLuint findTextureId(const std::string& path);
+
+        static unsigned getReferenceCount(TextureHandle handle);
+
+        // Absolute path with '/' separators and without "." or ".." parts, the path itself
+        // (only tidied up) when the file does not exist
+        static std::string getCanonicalPath(const std::string& path);
+
+        static TextureManagerStats getStats();
+    };
+}
+
+#endif /* TextureManager_hpp */
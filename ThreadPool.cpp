@@ -0,0 +1,64 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned threadCount)
+        : stopping(false) {
+
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            stopping = true;
+        }
+        tasksAvailable.notify_all();
+
+        // Workers drain the remaining tasks before exiting
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    unsigned ThreadPool::getThreadCount() const {
+        return (unsigned)workers.size();
+    }
+
+    ThreadPool& ThreadPool::getShared() {
+
+        static ThreadPool sharedPool;
+        return sharedPool;
+    }
+
+    void ThreadPool::workerLoop() {
+
+        for (;;) {
+
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(tasksMutex);
+                tasksAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+
+            task();
+        }
+    }
+
+}
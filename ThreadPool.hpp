@@ -0,0 +1,66 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Fixed set of worker threads consuming a FIFO of tasks
+    class ThreadPool {
+
+    public:
+        // 0 threads = one per hardware thread
+        explicit ThreadPool(unsigned threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        unsigned getThreadCount() const;
+
+        // Queues a task and returns a future for its result
+        template <typename F>
+        std::future<typename std::result_of<F()>::type> submit(F task);
+
+        // Pool shared by the asset loaders, sized to the machine
+        static ThreadPool& getShared();
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex tasksMutex;
+        std::condition_variable tasksAvailable;
+        bool stopping;
+
+        void workerLoop();
+    };
+
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> ThreadPool::submit(F task) {
+
+        typedef typename std::result_of<F()>::type Result;
+
+        // std::function needs a copyable callable, so the packaged_task lives on the heap
+        std::shared_ptr<std::packaged_task<Result()>> packagedTask =
+            std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packagedTask->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            tasks.push([packagedTask]() { (*packagedTask)(); });
+        }
+        tasksAvailable.notify_one();
+
+        return result;
+    }
+
+}
+
+#endif /* ThreadPool_hpp */
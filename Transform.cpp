@@ -0,0 +1,146 @@
+#include "Transform.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+namespace gps {
+
+	static unsigned recomputeCount = 0;
+
+	Transform::Transform() : position(0.0f), rotation(1.0f), scale(1.0f), parent(NULL),
+		localMatrix(1.0f), worldMatrix(1.0f), normalMatrix(1.0f),
+		localDirty(false), worldDirty(false), normalDirty(false), boundsDirty(false),
+		worldVersion(0), parentVersion(0) {
+	}
+
+	void Transform::setPosition(const glm::vec3& position) {
+
+		if (position != this->position) {
+			this->position = position;
+			invalidateLocal();
+		}
+	}
+
+	void Transform::setRotation(const glm::mat3& rotation) {
+
+		if (rotation != this->rotation) {
+			this->rotation = rotation;
+			invalidateLocal();
+		}
+	}
+
+	void Transform::setScale(const glm::vec3& scale) {
+
+		if (scale != this->scale) {
+			this->scale = scale;
+			invalidateLocal();
+		}
+	}
+
+	void Transform::setParent(const Transform* parent) {
+
+		if (parent != this->parent) {
+			this->parent = parent;
+			invalidateWorld();
+		}
+	}
+
+	void Transform::setLocalBounds(const BoundingBox& bounds) {
+
+		localBounds = bounds;
+		boundsDirty = true;
+	}
+
+	glm::vec3 Transform::getPosition() const {
+		return position;
+	}
+
+	glm::mat3 Transform::getRotation() const {
+		return rotation;
+	}
+
+	glm::vec3 Transform::getScale() const {
+		return scale;
+	}
+
+	const glm::mat4& Transform::getLocalMatrix() const {
+
+		if (localDirty) {
+			localMatrix = glm::mat4(rotation);
+			localMatrix[0] *= scale.x;
+			localMatrix[1] *= scale.y;
+			localMatrix[2] *= scale.z;
+			localMatrix[3] = glm::vec4(position, 1.0f);
+			localDirty = false;
+			recomputeCount++;
+		}
+		return localMatrix;
+	}
+
+	const glm::mat4& Transform::getWorldMatrix() const {
+
+		if (parent) {
+			const glm::mat4& parentWorld = parent->getWorldMatrix();
+			if (parent->worldVersion != parentVersion) {
+				parentVersion = parent->worldVersion;
+				invalidateWorld();
+			}
+			if (worldDirty) {
+				worldMatrix = parentWorld * getLocalMatrix();
+				recomputeCount++;
+			}
+		} else if (worldDirty) {
+			// Without a parent the world matrix is the local one
+			worldMatrix = getLocalMatrix();
+		}
+
+		if (worldDirty) {
+			worldDirty = false;
+			worldVersion++;
+		}
+		return worldMatrix;
+	}
+
+	const glm::mat3& Transform::getNormalMatrix() const {
+
+		const glm::mat4& world = getWorldMatrix();
+		if (normalDirty) {
+			normalMatrix = glm::inverseTranspose(glm::mat3(world));
+			normalDirty = false;
+			recomputeCount++;
+		}
+		return normalMatrix;
+	}
+
+	const BoundingBox& Transform::getWorldBounds() const {
+
+		const glm::mat4& world = getWorldMatrix();
+		if (boundsDirty) {
+			worldBounds = localBounds.transform(world);
+			boundsDirty = false;
+			recomputeCount++;
+		}
+		return worldBounds;
+	}
+
+	unsigned Transform::getRecomputeCount() {
+		return recomputeCount;
+	}
+
+	void Transform::resetRecomputeCount() {
+		recomputeCount = 0;
+	}
+
+	void Transform::invalidateLocal() {
+
+		localDirty = true;
+		invalidateWorld();
+	}
+
+	void Transform::invalidateWorld() const {
+
+		worldDirty = true;
+		normalDirty = true;
+		boundsDirty = true;
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef Transform_hpp
+#define Transform_hpp
+
+#include <glm/glm.hpp>
+
+#include "BoundingBox.h"
+
+namespace gps {
+
+    // Position, rotation and scale of an object, and the matrices and bounds derived from them.
+    // Derived values are only recomputed when read after one of their inputs changed, so setting
+    // the same transform several times a frame costs nothing until the frame reads it.
+    class Transform {
+
+    public:
+        Transform();
+
+        void setPosition(const glm::vec3& position);
+        void setRotation(const glm::mat3& rotation);
+        void setScale(const glm::vec3& scale);
+
+        // The world matrix becomes parent world * local, and follows the parent's changes
+        void setParent(const Transform* parent);
+
+        // Bounds in local space, getWorldBounds() moves them with the world matrix
+        void setLocalBounds(const BoundingBox& bounds);
+
+        glm::vec3 getPosition() const;
+        glm::mat3 getRotation() const;
+        glm::vec3 getScale() const;
+
+        // translate(position) * rotation * scale(scale)
+        const glm::mat4& getLocalMatrix() const;
+        const glm::mat4& getWorldMatrix() const;
+        // Inverse transpose of the world matrix, for normals
+        const glm::mat3& getNormalMatrix() const;
+        const BoundingBox& getWorldBounds() const;
+
+        // Matrices and bounds recomputed by all transforms since the last reset, reset it once per frame
+        static unsigned getRecomputeCount();
+        static void resetRecomputeCount();
+
+    private:
+        glm::vec3 position;
+        glm::mat3 rotation;
+        glm::vec3 scale;
+        const Transform* parent;
+        BoundingBox localBounds;
+
+        // Cached values, computed on first use after they went stale
+        mutable glm::mat4 localMatrix;
+        mutable glm::mat4 worldMatrix;
+        mutable glm::mat3 normalMatrix;
+        mutable BoundingBox worldBounds;
+        mutable bool localDirty;
+        mutable bool worldDirty;
+        mutable bool normalDirty;
+        mutable bool boundsDirty;
+        // Bumped on every world matrix change, children compare it with the one they were built from
+        mutable unsigned worldVersion;
+        mutable unsigned parentVersion;
+
+        // Marks everything derived from the local matrix stale
+        void invalidateLocal();
+        // Marks everything derived from the world matrix stale
+        void invalidateWorld() const;
+    };
+}
+
+#endif /* Transform_hpp */
@@ -0,0 +1,53 @@
+#include "UniformBuffer.hpp"
+
+namespace gps {
+
+	UniformBuffer::UniformBuffer() : buffer(0) {
+	}
+
+	UniformBuffer::~UniformBuffer() {
+		destroy();
+	}
+
+	void UniformBuffer::destroy() {
+
+		if (buffer) {
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+		}
+	}
+
+	void UniformBuffer::update(const void* data, size_t size) {
+
+		if (!buffer) {
+			glGenBuffers(1, &buffer);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, size, data, GL_STREAM_DRAW);
+	}
+
+	void UniformBuffer::bindBase(GLuint binding) const {
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+	}
+
+	void UniformBuffer::bindRange(GLuint binding, size_t offset, size_t size) const {
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+	}
+
+	GLuint UniformBuffer::getBuffer() const {
+		return buffer;
+	}
+
+	size_t UniformBuffer::getOffsetAlignment() {
+
+		static GLint alignment = 0;
+		if (!alignment) {
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+			// The spec allows at most 256
+			if (alignment <= 0) {
+				alignment = 256;
+			}
+		}
+		return (size_t)alignment;
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef UniformBuffer_hpp
+#define UniformBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+namespace gps {
+
+    // Binding points of the uniform blocks shared by the shaders
+    enum UniformBlockBinding {
+
+        FrameBlockBinding = 0,
+        ObjectBlockBinding = 1
+    };
+
+    // std140 layout of the FrameUniforms block, uploaded once per frame
+    struct FrameUniforms {
+
+        glm::mat4 view;
+        glm::mat4 projection;
+        // Eye space, w unused
+        glm::vec4 lightDir;
+        glm::vec4 lightColor;
+        glm::vec4 lightPos;
+    };
+
+    // std140 layout of the ObjectUniforms block, one per drawn object
+    struct ObjectUniforms {
+
+        glm::mat4 model;
+        // Inverse transpose of view * model, only the upper 3x3 is used
+        glm::mat4 normalMatrix;
+    };
+
+    // A GL uniform buffer whose whole contents are replaced on each update
+    class UniformBuffer {
+
+    public:
+        UniformBuffer();
+        ~UniformBuffer();
+
+        // Deletes the buffer while the context is still current, the destructor then has nothing left to do
+        void destroy();
+
+        // Uploads size bytes, orphaning the previous storage so the GPU can still read it
+        void update(const void* data, size_t size);
+
+        void bindBase(GLuint binding) const;
+
+        // Binds part of the buffer, offset must be a multiple of getOffsetAlignment()
+        void bindRange(GLuint binding, size_t offset, size_t size) const;
+
+        GLuint getBuffer() const;
+
+        // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+        static size_t getOffsetAlignment();
+
+    private:
+        GLuint buffer;
+
+        UniformBuffer(const UniformBuffer&);
+        UniformBuffer& operator=(const UniformBuffer&);
+    };
+}
+
+#endif /* UniformBuffer_hpp */
@@ -15,9 +15,27 @@
 
 #include "Shader.hpp"
 #include "Model3D.hpp"
+#include "GLState.hpp"
+#include "RenderQueue.hpp"
+#include "ModelInstances.hpp"
+#include "UniformBuffer.hpp"
+#include "StreamBuffer.hpp"
 #include "Camera.hpp"
-
+#include "Transform.hpp"
+#include "SceneSnapshot.hpp"
+#include "Framebuffer.hpp"
+#include "Profiler.hpp"
+#include "FrameStatistics.hpp"
+#include "AssetBenchmark.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <string>
+#include <thread>
 #include "Airplane.cpp"
 
 int glWindowWidth = 800;
@@ -25,23 +43,18 @@ int glWindowHeight = 600;
 int retina_width, retina_height;
 GLFWwindow* glWindow = NULL;
 
-glm::mat4 airportModelMatrix;
-GLuint airportModelLoc;
+gps::Transform airportTransform;
 glm::mat4 view;
-GLuint viewLoc;
 glm::mat4 projection;
-GLuint projectionLoc;
-glm::mat3 normalMatrix;
-GLuint normalMatrixLoc;
 glm::vec3 ground;
 
 glm::mat4 airplaneModelMatrix;
-GLuint airplaneModelLoc;
 
 glm::vec3 lightDir;
-GLuint lightDirLoc;
 glm::vec3 lightColor;
-GLuint lightColorLoc;
+// Per-frame uniforms and instance data, in a ring the GPU reads while the next frames are written
+gps::StreamBuffer streamBuffer;
+size_t streamFrameSize = 1024 * 1024;
 
 gps::Camera myCamera(
 	glm::vec3(-20.0f, 5.0f, -60.0f),
@@ -50,6 +63,72 @@ gps::Camera myCamera(
 float cameraSpeed = 0.5f;
 float airplaneSpeed = 5.0f;
 float groundOffset = 2.5f;
+size_t uploadBudget = 8 * 1024 * 1024; // bytes of model data sent to the GPU per frame while loading
+unsigned long long transformRecomputes = 0; // matrices and bounds rebuilt over the run, see gps::Transform
+unsigned long long frameCount = 0;
+double maxFrameTime = 0.25; // seconds of simulation caught up per frame at most, the rest is dropped after a stall
+unsigned long long simulationSteps = 0;
+
+// The main thread simulates and publishes snapshots, the render thread owns the GL context and draws them
+gps::SnapshotBuffer sceneSnapshots;
+unsigned long long renderedFrames = 0;
+// Set by the load callbacks on the render thread, picked up by the simulation
+std::atomic<bool> airportLoaded(false);
+std::atomic<bool> airplaneLoaded(false);
+
+// --headless WIDTHxHEIGHT renders headlessFrames frames offscreen, without input, and writes each one
+// to frameOutputPrefix + frame number + frameOutputExtension (.png, or .rgba for raw pixels)
+bool headless = false;
+bool headlessEgl = false; // --egl, otherwise the context comes from OSMesa where the platform has it
+int headlessFrames = 60;
+double fixedFrameTime = 1.0 / 60.0; // simulated seconds per frame in headless and benchmark runs, so they repeat exactly
+std::string frameOutputPrefix = "frame_";
+std::string frameOutputExtension = ".png";
+gps::Framebuffer offscreenFramebuffer;
+
+// --profile FILE records CPU and GPU zones and writes them as a Chrome trace at exit
+std::string profileOutput;
+
+// --benchmark FILE flies flightPath with vsync off and writes frame time percentiles,
+// draw calls and triangles per frame as JSON
+std::string benchmarkOutput;
+gps::FrameStatistics benchmarkStats;
+std::string glRenderer;
+
+// --asset-benchmark FILE times each loading stage on the bundled and generated assets and writes
+// milliseconds and MB/s per stage as JSON, then exits without rendering
+std::string assetBenchmarkOutput;
+
+// Keys held through each part of the benchmark flight, flown in order
+struct FlightSegment {
+	const char* name;
+	double duration; // seconds
+	bool throttle;
+	bool left;
+	bool right;
+};
+
+// The flight model cannot turn back (yaw is clamped) and keeps climbing under throttle,
+// so the low pass is flown with throttle bursts while the airplane is still over the airport
+const FlightSegment flightPath[] = {
+	{ "takeoff roll", 2.2, true, false, false },
+	{ "left bank", 1.2, true, true, false },
+	{ "right bank", 1.2, true, false, true },
+	{ "descent", 2.5, false, false, false },
+	{ "low pass", 0.8, true, false, false },
+	{ "low pass coast", 0.8, false, false, false },
+	{ "low pass", 0.8, true, false, false },
+	{ "low pass coast", 0.8, false, false, false },
+	{ "low pass", 0.8, true, false, false },
+	{ "low pass coast", 0.8, false, false, false },
+};
+
+// Order of the objects in SceneSnapshot::objects
+enum SceneObject {
+	SceneObjectAirport = 0,
+	SceneObjectAirplane = 1,
+	SceneObjectCount
+};
 
 glm::vec3 cameraOffset(0.0f, 5.0f, 20.0f);
 
@@ -58,15 +137,35 @@ bool pressedKeys[1024];
 gps::Model3D airportModel;
 BoundingBox airportBoundingBox;
 glm::vec3 airplanePosition(0.0f, 6.0f, -60.0f);
-Airplane airplane(airplanePosition, glm::mat4(1.0f), 0, BoundingBox());
+Airplane airplane(airplanePosition, BoundingBox());
 gps::Shader myCustomShader;
+gps::RenderQueue renderQueue;
 
 gps::Model3D airplaneModel;
 BoundingBox airplaneBoundingBox;
-GLuint objectIDLoc;
+
+// Parked and taxiing airplanes, drawn with one instanced draw per submesh
+gps::Shader instancedShader;
+gps::ModelInstances airplaneFleet(airplaneModel);
+
+struct FleetAirplane {
+	Airplane airplane;
+	// Identifies the airplane to the renderer for as long as it exists
+	unsigned key;
+	bool taxiing;
+};
+std::vector<FleetAirplane> fleetAirplanes;
+unsigned nextFleetKey = 0;
+// Taxiing airplanes roll along the lane in front of the parked rows, leaving at its end
+const float taxiStartX = 40.0f;
+const float taxiEndX = 440.0f;
+const float taxiLaneZ = -150.0f;
+const float taxiSpeed = 8.0f;
+const int taxiingCount = 4;
+// Render thread side, the instance of each fleet key in the last drawn snapshot
+std::map<unsigned, unsigned> fleetInstanceIds;
 
 glm::vec3 lightPos;
-GLuint lightPosLoc;
 
 GLuint diffuseTexture;
 GLuint specularTexture;
@@ -100,15 +199,18 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	glWindowWidth = width;
 	glWindowHeight = height;
 	glfwGetFramebufferSize(window, &retina_width, &retina_height);
-	glViewport(0, 0, retina_width, retina_height);
+	// The render thread sets the viewport from the next snapshot
 	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 }
 
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 
+	// The benchmark flight holds the keys itself, stray input would change the replay
+	if (!benchmarkOutput.empty())
+		return;
+
 	if (key >= 0 && key < 1024)
 	{
 		if (action == GLFW_PRESS)
@@ -118,47 +220,25 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 	}
 }
 
+// Follows the interpolated airplane, so the camera moves smoothly between simulation steps
 void updateCameraPosition() {
-	glm::vec3 airplanePosition = airplane.getPosition();
-	glm::vec3 forwardDirection = airplane.getForwardDirection();
+	glm::vec3 airplanePosition = airplane.getRenderPosition();
+	glm::vec3 forwardDirection = airplane.getRenderForwardDirection();
 
-	glm::vec3 newCameraPosition = airplanePosition - (forwardDirection * cameraOffset.z) + (airplane.getUpDirection() * cameraOffset.y);
+	glm::vec3 newCameraPosition = airplanePosition - (forwardDirection * cameraOffset.z) + (airplane.getRenderUpDirection() * cameraOffset.y);
 
 	myCamera.setPosition(newCameraPosition);
 	myCamera.setTarget(airplanePosition);
-
-	view = myCamera.getViewMatrix();
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 }
 
+// One simulation step of the player's airplane, run at the airplane's fixed time step
 void processMovement()
 {
-	glm::vec3 currentPosition = myCamera.getPosition();
-	glm::vec3 newPosition = currentPosition;
-	//std::cout << airplane.getBoundingBox().min.y + airportBoundingBox.min.y << '\n';
-	if (airplane.getBoundingBox().intersects(airportBoundingBox) || airplane.getPosition().y <= 3.0f) {
-		std::cout << "teapa fraiere\n";
-	}
-
 	if (pressedKeys[GLFW_KEY_W]) {
 		airplane.moveForward(true);
-		/*newPosition = myCamera.getPosition();
-		if (newPosition.y < ground.y) {
-			currentPosition.y += 0.1f;
-			myCamera.setPosition(currentPosition);
-		}*/
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 	else if (pressedKeys[GLFW_KEY_S]) {
 		airplane.moveBackward(true);
-		newPosition = myCamera.getPosition();
-		if (newPosition.y < ground.y) {
-			currentPosition.y += 0.1f;
-			myCamera.setPosition(currentPosition);
-		}
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 	else {
 		airplane.moveForward(false);
@@ -166,71 +246,122 @@ void processMovement()
 
 	if (pressedKeys[GLFW_KEY_A]) {
 		airplane.turnLeft();
+	}
+	else if (pressedKeys[GLFW_KEY_D]) {
+		airplane.turnRight();
+	}
+	else {
+		airplane.levelRoll();
+		airplane.levelYaw();
+	}
+}
+
+// Once per rendered frame, after the camera followed the airplane
+void processCameraMovement()
+{
+	glm::vec3 currentPosition = myCamera.getPosition();
+	glm::vec3 newPosition = currentPosition;
+	if (pressedKeys[GLFW_KEY_S]) {
 		newPosition = myCamera.getPosition();
 		if (newPosition.y < ground.y) {
 			currentPosition.y += 0.1f;
 			myCamera.setPosition(currentPosition);
 		}
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
-	else if (pressedKeys[GLFW_KEY_D]) {
-		airplane.turnRight();
+
+	if (pressedKeys[GLFW_KEY_A] || pressedKeys[GLFW_KEY_D]) {
 		newPosition = myCamera.getPosition();
 		if (newPosition.y < ground.y) {
 			currentPosition.y += 0.1f;
 			myCamera.setPosition(currentPosition);
 		}
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
-	else {
-		airplane.levelRoll();
-		airplane.levelYaw();
-	}
-	
 
 	if (pressedKeys[GLFW_KEY_UP]) {
 		myCamera.rotate(cameraSpeed, 0.0f);
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 
 	if (pressedKeys[GLFW_KEY_DOWN]) {
 		myCamera.rotate(-cameraSpeed, 0.0f);
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 
 	if (pressedKeys[GLFW_KEY_LEFT]) {
 		myCamera.rotate(0.0f, -cameraSpeed);
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 
 	if (pressedKeys[GLFW_KEY_RIGHT]) {
 		myCamera.rotate(0.0f, cameraSpeed);
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 	}
 
-	airplane.updateShader();
+	// The camera is done moving for this frame
+	view = myCamera.getViewMatrix();
+}
+
+void addFleetAirplane(const Airplane& fleetAirplane, bool taxiing) {
+	FleetAirplane added = { fleetAirplane, nextFleetKey++, taxiing };
+	fleetAirplanes.push_back(added);
+}
+
+void removeFleetAirplane(size_t index) {
+	fleetAirplanes.erase(fleetAirplanes.begin() + index);
+}
+
+// One simulation step of the taxiing airplanes, one that reaches the end of the lane is replaced at its start
+void updateFleetSimulation() {
+	for (size_t i = 0; i < fleetAirplanes.size(); i++) {
+		if (!fleetAirplanes[i].taxiing) {
+			continue;
+		}
+		fleetAirplanes[i].airplane.taxi(taxiSpeed);
+		if (fleetAirplanes[i].airplane.getPosition().x > taxiEndX) {
+			removeFleetAirplane(i--);
+			Airplane taxiingAirplane(glm::vec3(taxiStartX, 3.0f, taxiLaneZ), BoundingBox());
+			addFleetAirplane(taxiingAirplane, true);
+		}
+	}
+}
+
+// Runs as many fixed steps as the elapsed time covers, the remainder carries over to the next frame
+void updateSimulation(double frameTime, double& accumulator) {
+	double timeStep = airplane.getTimeStep();
+	accumulator += glm::min(frameTime, maxFrameTime);
+
+	while (accumulator >= timeStep) {
+		airplane.beginStep();
+		{
+			gps::ProfileScope zone("applyGravity");
+			airplane.applyGravity();
+		}
+		{
+			gps::ProfileScope zone("processMovement");
+			processMovement();
+		}
+		{
+			gps::ProfileScope zone("updateFleetSimulation");
+			updateFleetSimulation();
+		}
+		accumulator -= timeStep;
+		simulationSteps++;
+	}
+
+	//std::cout << airplane.getBoundingBox().min.y + airportBoundingBox.min.y << '\n';
+	if (airplane.getBoundingBox().intersects(airportBoundingBox) || airplane.getPosition().y <= 3.0f) {
+		std::cout << "teapa fraiere\n";
+	}
+
+	// What is left of a step decides how far rendering is between the last two states
+	airplane.interpolate((float)(accumulator / timeStep));
 }
 
 bool initOpenGLWindow()
 {
+#if defined (GLFW_PLATFORM_NULL)
+	// GLFW 3.4 can run without a display server, the window is never shown anyway
+	if (headless) {
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	}
+#endif
+
 	if (!glfwInit()) {
 		fprintf(stderr, "ERROR: could not start GLFW3\n");
 		return false;
@@ -245,6 +376,17 @@ bool initOpenGLWindow()
 	glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 	glfwWindowHint(GLFW_SAMPLES, 4);
 
+	if (headless || !assetBenchmarkOutput.empty()) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
+
+	if (headless) {
+#if !defined (_WIN32) && !defined (__APPLE__)
+		// Both work on machines without a GPU through Mesa's llvmpipe
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, headlessEgl ? GLFW_EGL_CONTEXT_API : GLFW_OSMESA_CONTEXT_API);
+#endif
+	}
+
 	glWindow = glfwCreateWindow(glWindowWidth, glWindowHeight, "OpenGL Shader Example", NULL, NULL);
 	if (!glWindow) {
 		fprintf(stderr, "ERROR: could not open window with GLFW3\n");
@@ -256,7 +398,10 @@ bool initOpenGLWindow()
 	glfwSetKeyCallback(glWindow, keyboardCallback);
 
 	glfwMakeContextCurrent(glWindow);
-	glfwSwapInterval(1);
+	if (!headless) {
+		// Benchmarks measure the renderer, not the display
+		glfwSwapInterval(benchmarkOutput.empty() ? 1 : 0);
+	}
 
 #if not defined (__APPLE__)
 	glewExperimental = GL_TRUE;
@@ -266,10 +411,53 @@ bool initOpenGLWindow()
 	const GLubyte* renderer = glGetString(GL_RENDERER);
 	const GLubyte* version = glGetString(GL_VERSION);
 	printf("Renderer: %s\n", renderer);
+	glRenderer = renderer ? (const char*)renderer : "";
 	printf("OpenGL version supported %s\n", version);
 
 	glfwGetFramebufferSize(glWindow, &retina_width, &retina_height);
+	if (headless) {
+		// Frames go to the offscreen framebuffer, at exactly the requested size
+		retina_width = glWindowWidth;
+		retina_height = glWindowHeight;
+	}
+
+	return true;
+}
 
+// Returns false on arguments it does not understand
+bool parseArguments(int argc, const char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+			headless = true;
+			if (sscanf(argv[++i], "%dx%d", &glWindowWidth, &glWindowHeight) != 2 || glWindowWidth <= 0 || glWindowHeight <= 0) {
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			headlessFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			frameOutputPrefix = argv[++i];
+		}
+		else if (strcmp(argv[i], "--raw") == 0) {
+			frameOutputExtension = ".rgba";
+		}
+		else if (strcmp(argv[i], "--egl") == 0) {
+			headlessEgl = true;
+		}
+		else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			profileOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+			benchmarkOutput = argv[++i];
+		}
+		else if (strcmp(argv[i], "--asset-benchmark") == 0 && i + 1 < argc) {
+			assetBenchmarkOutput = argv[++i];
+		}
+		else {
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -285,106 +473,402 @@ void initOpenGLState()
 	glFrontFace(GL_CCW);
 
 	glEnable(GL_FRAMEBUFFER_SRGB);
+
+	streamBuffer.init(streamFrameSize);
+	renderQueue.setStreamBuffer(&streamBuffer);
+	airplaneFleet.setStreamBuffer(&streamBuffer);
 }
 
 void initObjects() {
-	airportModel.LoadModel("objects/airport/airport.obj", "objects/airport/");
-	airportBoundingBox = airportModel.getBoundingBox();
+	if (headless || !benchmarkOutput.empty()) {
+		// Every written or measured frame shows the whole scene
+		airportModel.LoadModel("objects/airport/airport.obj", "objects/airport/");
+		airplaneModel.setQuantizeVertices(true);
+		airplaneModel.LoadModel("objects/airplane/airplane.obj", "objects/airplane/");
+		airportLoaded = true;
+		airplaneLoaded = true;
+		return;
+	}
+
+	// Models stream in while the scene is already rendering
+	airportModel.LoadModelAsync("objects/airport/airport.obj", "objects/airport/", []() {
+		airportLoaded = true;
+	});
+
+	// The airplane is small enough for 16 bit positions
+	airplaneModel.setQuantizeVertices(true);
+	airplaneModel.LoadModelAsync("objects/airplane/airplane.obj", "objects/airplane/", []() {
+		airplaneLoaded = true;
+	});
+}
+
+// Bounds of models the render thread finished uploading, on the simulation's side
+void applyLoadedModels() {
+	if (airportLoaded.exchange(false)) {
+		airportTransform.setLocalBounds(airportModel.getBoundingBox());
+		airportBoundingBox = airportTransform.getWorldBounds();
+	}
 
-	airplaneModel.LoadModel("objects/airplane/airplane.obj", "objects/airplane/");
-	airplaneBoundingBox = airplaneModel.getBoundingBox();
+	if (airplaneLoaded.exchange(false)) {
+		// Model space, the airplane's transform places it
+		airplaneBoundingBox = airplaneModel.getBoundingBox();
+		airplane.setBoundingBox(airplaneBoundingBox);
+	}
 }
 
 void initShaders() {
+	instancedShader.loadShader("shaders/shaderInstanced.vert", "shaders/shaderStart.frag");
+	instancedShader.bindUniformBlock("FrameUniforms", gps::FrameBlockBinding);
+
 	myCustomShader.loadShader("shaders/shaderStart.vert", "shaders/shaderStart.frag");
 	myCustomShader.useShaderProgram();
+	myCustomShader.bindUniformBlock("FrameUniforms", gps::FrameBlockBinding);
+	myCustomShader.bindUniformBlock("ObjectUniforms", gps::ObjectBlockBinding);
 }
 
-void initUniforms() {
-	objectIDLoc = glGetUniformLocation(myCustomShader.shaderProgram, "objectID");
-	normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
+// Instances follow the airplanes of the snapshot by key: kept ones are updated, new ones added, gone ones removed
+void updateFleet(const gps::SceneSnapshot& snapshot) {
+	std::map<unsigned, unsigned> instanceIds;
+	for (size_t i = 0; i < snapshot.instances.size(); i++) {
+		std::map<unsigned, unsigned>::iterator found = fleetInstanceIds.find(snapshot.instanceKeys[i]);
+		if (found != fleetInstanceIds.end()) {
+			airplaneFleet.update(found->second, snapshot.instances[i]);
+			instanceIds[found->first] = found->second;
+			fleetInstanceIds.erase(found);
+		} else {
+			instanceIds[snapshot.instanceKeys[i]] = airplaneFleet.add(snapshot.instances[i]);
+		}
+	}
+	for (std::map<unsigned, unsigned>::iterator it = fleetInstanceIds.begin(); it != fleetInstanceIds.end(); ++it) {
+		airplaneFleet.remove(it->second);
+	}
+	fleetInstanceIds.swap(instanceIds);
+}
 
-	airportModelMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(0.25f, 0.25f, 0.25f)); // Airport is MASSIVE
-	airportModelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "airportModel");
-	airportBoundingBox = airportBoundingBox.transform(airportModelMatrix);
-	glUniformMatrix4fv(airportModelLoc, 1, GL_FALSE, glm::value_ptr(airportModelMatrix));
+// Rows of parked airplanes next to the runway, and a few taxiing in front of them
+void initFleet() {
+	for (int row = 0; row < 10; row++) {
+		for (int column = 0; column < 20; column++) {
+			Airplane parkedAirplane(glm::vec3(40.0f + column * 20.0f, 3.0f, -120.0f + row * 25.0f), BoundingBox());
+			parkedAirplane.applyGravity(); // settles it on the ground
+			addFleetAirplane(parkedAirplane, false);
+		}
+	}
+	for (int i = 0; i < taxiingCount; i++) {
+		float x = taxiStartX + (taxiEndX - taxiStartX) * i / taxiingCount;
+		Airplane taxiingAirplane(glm::vec3(x, 3.0f, taxiLaneZ), BoundingBox());
+		addFleetAirplane(taxiingAirplane, true);
+	}
+}
+
+// View, projection and light go to the FrameUniforms block each frame, model matrices to ObjectUniforms per draw
+void initUniforms() {
+	airportTransform.setScale(glm::vec3(0.25f, 0.25f, 0.25f)); // Airport is MASSIVE
 
 	airplaneModelMatrix = glm::translate(glm::mat4(1.0f), airplanePosition);
 	airplaneModelMatrix = glm::scale(airplaneModelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));
 	airplaneModelMatrix = glm::rotate(airplaneModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 	airplaneModelMatrix = glm::rotate(airplaneModelMatrix, glm::radians(-15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	airplaneModelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "airplaneModel");
-	airplaneBoundingBox = airplaneBoundingBox.transform(airplaneModelMatrix);
-	glUniformMatrix4fv(airplaneModelLoc, 1, GL_FALSE, glm::value_ptr(airplaneModelMatrix));
 
-	airplane = Airplane(airplanePosition, airplaneModelMatrix, airplaneModelLoc, airplaneBoundingBox);
+	airplane = Airplane(airplanePosition, airplaneBoundingBox);
 
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
 	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-	projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	renderQueue.setDepthRange(1000.0f);
 
 	lightDir = glm::vec3(0.0f, -1.0f, 1.0f);
-	lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightDir");
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view)) * lightDir));
-
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-	lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightColor");
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
-
 	lightPos = glm::vec3(0.0f, 1.0f, 1.0f);
-	lightPosLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightPos");
-	glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightPos));
 
-	diffuseTextureLoc = glGetUniformLocation(myCustomShader.shaderProgram, "diffuseTexture");
+	diffuseTextureLoc = myCustomShader.getUniformLocation("diffuseTexture");
 	glUniform1i(diffuseTextureLoc, 0);
-	specularTextureLoc = glGetUniformLocation(myCustomShader.shaderProgram, "specularTexture");
+	specularTextureLoc = myCustomShader.getUniformLocation("specularTexture");
 	glUniform1i(specularTextureLoc, 1);
 }
 
-void renderScene() {
+// Holds the keys of the flight segment at time seconds into the benchmark, returns false past the end
+bool applyFlightPath(double time) {
+	double segmentEnd = 0.0;
+	for (size_t i = 0; i < sizeof(flightPath) / sizeof(flightPath[0]); i++) {
+		segmentEnd += flightPath[i].duration;
+		if (time < segmentEnd) {
+			memset(pressedKeys, 0, sizeof(pressedKeys));
+			pressedKeys[GLFW_KEY_W] = flightPath[i].throttle;
+			pressedKeys[GLFW_KEY_A] = flightPath[i].left;
+			pressedKeys[GLFW_KEY_D] = flightPath[i].right;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Whether the main loop goes on. Benchmarks also set the frame's input here.
+bool nextFrame() {
+	if (!benchmarkOutput.empty()) {
+		return applyFlightPath(frameCount * fixedFrameTime);
+	}
+	if (headless) {
+		return frameCount < (unsigned long long)headlessFrames;
+	}
+	return !glfwWindowShouldClose(glWindow);
+}
+
+// Fills the snapshot the render thread draws next, from the simulation's state after this frame
+void writeSnapshot(gps::SceneSnapshot& snapshot) {
+	snapshot.view = view;
+	snapshot.projection = projection;
+	snapshot.viewportWidth = retina_width;
+	snapshot.viewportHeight = retina_height;
+	snapshot.lightDir = lightDir;
+	snapshot.lightColor = lightColor;
+	snapshot.lightPos = lightPos;
+
+	snapshot.objects.resize(SceneObjectCount);
+	snapshot.objects[SceneObjectAirport].model = airportTransform.getWorldMatrix();
+	snapshot.objects[SceneObjectAirport].normalMatrix = airportTransform.getNormalMatrix();
+	snapshot.objects[SceneObjectAirplane].model = airplane.getRenderModelMatrix();
+	snapshot.objects[SceneObjectAirplane].normalMatrix = airplane.getRenderNormalMatrix();
+
+	snapshot.instances.resize(fleetAirplanes.size());
+	snapshot.instanceKeys.resize(fleetAirplanes.size());
+	for (size_t i = 0; i < fleetAirplanes.size(); i++) {
+		snapshot.instances[i] = fleetAirplanes[i].airplane.getModelMatrix();
+		snapshot.instanceKeys[i] = fleetAirplanes[i].key;
+	}
+	snapshot.frame = frameCount;
+}
+
+// Render thread only, everything it reads comes from the snapshot
+void renderScene(const gps::SceneSnapshot& snapshot) {
+	gps::ProfileScope zone("renderScene");
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glUniform1i(objectIDLoc, 0); // Set objectID to 0 for airport
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * airportModelMatrix));
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	airportModel.Draw(myCustomShader);
-
-	glUniform1i(objectIDLoc, 1); // Set objectID to 1 for airplane
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * airplaneModelMatrix));
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	airplaneModel.Draw(myCustomShader);
+	gps::Model3D::resetCullingStats();
+	renderQueue.clear();
+
+	// Shadow the simulation's globals, which keep changing while this frame is drawn
+	const glm::mat4& view = snapshot.view;
+	const glm::mat4& projection = snapshot.projection;
+
+	gps::FrameUniforms frameUniforms;
+	frameUniforms.view = view;
+	frameUniforms.projection = projection;
+	frameUniforms.lightDir = glm::vec4(glm::inverseTranspose(glm::mat3(view)) * snapshot.lightDir, 0.0f);
+	frameUniforms.lightColor = glm::vec4(snapshot.lightColor, 1.0f);
+	frameUniforms.lightPos = glm::vec4(snapshot.lightPos, 1.0f);
+	gps::StreamAllocation frameAllocation = streamBuffer.write(&frameUniforms, sizeof(frameUniforms), gps::UniformBuffer::getOffsetAlignment());
+	glBindBufferRange(GL_UNIFORM_BUFFER, gps::FrameBlockBinding, frameAllocation.buffer, frameAllocation.offset, sizeof(frameUniforms));
+
+	// The view has no scale, so the eye space normal matrix is the view rotation times the world one
+	glm::mat3 viewRotation = glm::mat3(view);
+
+	const gps::SnapshotObject& airportPlacement = snapshot.objects[SceneObjectAirport];
+	gps::ObjectUniforms airportObject;
+	airportObject.model = airportPlacement.model;
+	airportObject.normalMatrix = glm::mat4(viewRotation * airportPlacement.normalMatrix);
+	airportModel.Submit(renderQueue, myCustomShader, view * airportObject.model, projection, renderQueue.addObject(airportObject));
+
+	const gps::SnapshotObject& airplanePlacement = snapshot.objects[SceneObjectAirplane];
+	gps::ObjectUniforms airplaneObject;
+	airplaneObject.model = airplanePlacement.model;
+	airplaneObject.normalMatrix = glm::mat4(viewRotation * airplanePlacement.normalMatrix);
+	airplaneModel.Submit(renderQueue, myCustomShader, view * airplaneObject.model, projection, renderQueue.addObject(airplaneObject));
+
+	// Sorted by shader, material and depth, so shared textures are bound once
+	renderQueue.Execute();
+
+	updateFleet(snapshot);
+	airplaneFleet.Draw(instancedShader, view, projection);
+}
+
+// Draws each published snapshot until the buffer is closed, while the main thread simulates the next
+void renderLoop() {
+	gps::Profiler::setThreadName("Render");
+	glfwMakeContextCurrent(glWindow);
+	if (headless) {
+		offscreenFramebuffer.bind();
+	}
+
+	int viewportWidth = retina_width;
+	int viewportHeight = retina_height;
+	double lastFrameEnd = glfwGetTime();
+	gps::GLStateStats lastStats = gps::GLState::getStats();
+	while (sceneSnapshots.acquire()) {
+		const gps::SceneSnapshot& snapshot = sceneSnapshots.getReadSnapshot();
+
+		{
+			gps::ProfileScope zone("ProcessUploads");
+			gps::Model3D::ProcessUploads(uploadBudget);
+		}
+
+		if (snapshot.viewportWidth != viewportWidth || snapshot.viewportHeight != viewportHeight) {
+			viewportWidth = snapshot.viewportWidth;
+			viewportHeight = snapshot.viewportHeight;
+			glViewport(0, 0, viewportWidth, viewportHeight);
+		}
+
+		unsigned uniformLookups = gps::Shader::getNameLookupCount();
+		renderScene(snapshot);
+		streamBuffer.endFrame();
+		//per-draw uniforms go through the slots resolved at link time, never by name
+		if (gps::Shader::getNameLookupCount() != uniformLookups) {
+			std::cout << "# of uniform lookups this frame : " << gps::Shader::getNameLookupCount() - uniformLookups << std::endl;
+		}
+
+		if (!headless) {
+			gps::ProfileScope zone("glfwSwapBuffers");
+			glfwSwapBuffers(glWindow);
+		} else if (benchmarkOutput.empty()) {
+			gps::ProfileScope zone("SaveFrame");
+			char frameNumber[16];
+			snprintf(frameNumber, sizeof(frameNumber), "%05llu", snapshot.frame);
+			offscreenFramebuffer.SaveFrame(frameOutputPrefix + frameNumber + frameOutputExtension);
+		}
+
+		if (!benchmarkOutput.empty()) {
+			// Frame time is the interval between frame ends, which includes waiting on the GPU once it falls behind
+			double frameEnd = glfwGetTime();
+			gps::GLStateStats stats = gps::GLState::getStats();
+			// The first frame also pays for driver warm up
+			if (renderedFrames > 0) {
+				benchmarkStats.addFrame((frameEnd - lastFrameEnd) * 1000.0, stats.drawCalls - lastStats.drawCalls, stats.triangles - lastStats.triangles);
+			}
+			lastFrameEnd = frameEnd;
+			lastStats = stats;
+		}
+		gps::Profiler::endFrame();
+		renderedFrames++;
+	}
+
+	glfwMakeContextCurrent(NULL);
 }
 
 void cleanup() {
+	gps::GLStateStats stateStats = gps::GLState::getStats();
+	std::cout << "# of GL binds requested : " << stateStats.requested << ", skipped as redundant : " << stateStats.skipped << std::endl;
+	gps::TextureManagerStats textureStats = gps::TextureManager::getStats();
+	std::cout << "# of textures uploaded : " << textureStats.uploads << ", shared by path : " << textureStats.pathHits << ", by content : " << textureStats.hashHits << std::endl;
+	if (frameCount) {
+		std::cout << "# of transform recomputes per frame : " << (float)transformRecomputes / frameCount << std::endl;
+		std::cout << "# of simulation steps per frame : " << (float)simulationSteps / frameCount << std::endl;
+		std::cout << "# of frames simulated : " << frameCount << ", rendered : " << renderedFrames << std::endl;
+	}
+	std::cout << "# of stream buffer stalls : " << streamBuffer.getStallCount() << (streamBuffer.isPersistent() ? " (persistent)" : " (orphaning)") << std::endl;
+	// GL objects of the globals go while the context is current, their destructors run after glfwTerminate
+	renderQueue.destroy();
+	airplaneFleet.destroy();
+	airportModel.Release();
+	airplaneModel.Release();
+	streamBuffer.destroy();
+	offscreenFramebuffer.destroy();
 	glfwDestroyWindow(glWindow);
 	glfwTerminate();
 }
 
+// Times the loading stages of the bundled assets and of generated larger ones. Needs the GL context.
+bool runAssetBenchmark() {
+	gps::AssetBenchmark assetBenchmark;
+	assetBenchmark.RunModel("airplane", "objects/airplane/airplane.obj", "objects/airplane/");
+	assetBenchmark.RunModel("airport", "objects/airport/airport.obj", "objects/airport/");
+
+	// Generated identically on every run, so results compare across commits
+	const unsigned gridSizes[] = { 256, 1024 };
+	for (size_t i = 0; i < sizeof(gridSizes) / sizeof(gridSizes[0]); i++) {
+		std::string name = "grid" + std::to_string(gridSizes[i]);
+		std::string fileName = "asset_benchmark_" + name + ".obj";
+		if (gps::AssetBenchmark::WriteGridObj(fileName, gridSizes[i])) {
+			assetBenchmark.RunModel(name, fileName, "");
+		}
+		std::remove(fileName.c_str());
+	}
+
+	const int imageSizes[] = { 1024, 4096 };
+	for (size_t i = 0; i < sizeof(imageSizes) / sizeof(imageSizes[0]); i++) {
+		std::string name = "noise" + std::to_string(imageSizes[i]);
+		std::string fileName = "asset_benchmark_" + name + ".png";
+		if (gps::AssetBenchmark::WriteNoiseImage(fileName, imageSizes[i])) {
+			assetBenchmark.RunTexture(name, fileName);
+		}
+		std::remove(fileName.c_str());
+	}
+
+	assetBenchmark.setInfo("renderer", glRenderer);
+	std::cout << assetBenchmark.toJson() << std::endl;
+	return assetBenchmark.WriteJson(assetBenchmarkOutput);
+}
+
 int main(int argc, const char* argv[]) {
+	if (!parseArguments(argc, argv)) {
+		fprintf(stderr, "usage: %s [--headless WIDTHxHEIGHT [--frames N] [--output PREFIX] [--raw] [--egl]] [--profile TRACE.json] [--benchmark RESULT.json] [--asset-benchmark RESULT.json]\n", argv[0]);
+		return 1;
+	}
+
 	if (!initOpenGLWindow()) {
 		glfwTerminate();
 		return 1;
 	}
 
+	if (!assetBenchmarkOutput.empty()) {
+		bool written = runAssetBenchmark();
+		glfwDestroyWindow(glWindow);
+		glfwTerminate();
+		return written ? 0 : 1;
+	}
+
+	if (!profileOutput.empty()) {
+		gps::Profiler::setEnabled(true);
+		gps::Profiler::setThreadName("Main");
+	}
+
 	initOpenGLState();
+	if (headless && !offscreenFramebuffer.init(retina_width, retina_height)) {
+		cleanup();
+		return 1;
+	}
 	initObjects();
 	initShaders();
 	initUniforms();
+	initFleet();
 	updateCameraPosition();
 
-	while (!glfwWindowShouldClose(glWindow)) {
-		airplane.applyGravity();
-		updateCameraPosition();
-		processMovement();
-		renderScene();
+	// GL belongs to the render thread from here on
+	glfwMakeContextCurrent(NULL);
+	std::thread renderThread(renderLoop);
 
+	double accumulator = 0.0;
+	double lastTime = glfwGetTime();
+	while (nextFrame()) {
 		glfwPollEvents();
-		glfwSwapBuffers(glWindow);
+		gps::Transform::resetRecomputeCount();
+
+		applyLoadedModels();
+		double currentTime = glfwGetTime();
+		bool fixedTime = headless || !benchmarkOutput.empty();
+		updateSimulation(fixedTime ? fixedFrameTime : currentTime - lastTime, accumulator);
+		lastTime = currentTime;
+		updateCameraPosition();
+		processCameraMovement();
+
+		writeSnapshot(sceneSnapshots.getWriteSnapshot());
+		sceneSnapshots.publish();
+		transformRecomputes += gps::Transform::getRecomputeCount();
+		frameCount++;
 	}
 
+	sceneSnapshots.close();
+	renderThread.join();
+	glfwMakeContextCurrent(glWindow);
+
+	if (!profileOutput.empty()) {
+		gps::Profiler::WriteChromeTrace(profileOutput);
+	}
+	if (!benchmarkOutput.empty()) {
+		benchmarkStats.setInfo("renderer", glRenderer);
+		benchmarkStats.setInfo("resolution", std::to_string(retina_width) + "x" + std::to_string(retina_height));
+		benchmarkStats.setInfo("headless", headless ? "true" : "false");
+		std::cout << benchmarkStats.toJson() << std::endl;
+		benchmarkStats.WriteJson(benchmarkOutput);
+	}
 	cleanup();
 
 	return 0;
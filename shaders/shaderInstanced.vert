@@ -0,0 +1,55 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+
+// Per instance, from the instance buffer
+layout(location=3) in mat4 instanceModel;
+layout(location=7) in mat3 instanceNormalMatrix; // inverse transpose of instanceModel
+
+out vec3 fNormal;
+out vec4 fPosEye;
+out vec2 fragTexCoords; // Add this line
+
+// Quantized meshes: positions are unorm16 inside [positionMin, positionMin + positionExtent]
+// and normals are octahedral-encoded in vNormal.xy. Float meshes use an identity range.
+uniform bool quantizedVertices;
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
+
+// Node transform of glTF submeshes, applied before the model matrix. Identity for the others.
+uniform mat4 nodeMatrix;
+uniform mat3 nodeNormalMatrix; // inverse transpose of nodeMatrix
+
+// Shared by every draw of a frame
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightDir;
+    vec4 lightColor;
+    vec4 lightPos;
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+void main() 
+{
+    vec3 position = vec3(nodeMatrix * vec4(positionMin + vPosition * positionExtent, 1.0f));
+    vec3 normal = nodeNormalMatrix * (quantizedVertices ? decodeOctahedral(vNormal.xy) : vNormal);
+
+    // compute eye space coordinates
+    fPosEye = view * instanceModel * vec4(position, 1.0f);
+    // the view has no scale, its rotation moves the normals to eye space as is
+    fNormal = normalize(mat3(view) * instanceNormalMatrix * normal);
+    fragTexCoords = vTexCoords; // Add this line
+    gl_Position = projection * fPosEye;
+}
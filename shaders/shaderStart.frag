@@ -6,9 +6,15 @@ in vec2 fragTexCoords; // Add this line
 
 out vec4 fColor;
 
-// lighting
-uniform vec3 lightPos;
-uniform vec3 lightColor;
+// lighting, shared with the vertex shader
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightDir;
+    vec4 lightColor;
+    vec4 lightPos;
+};
 
 // texture samplers
 uniform sampler2D diffuseTexture;
@@ -32,25 +38,25 @@ void computeLightComponents()
     vec3 normalEye = normalize(fNormal);    
     
     // compute light direction
-    vec3 lightDir = normalize(lightPos - fPosEye.xyz);
+    vec3 lightDirN = normalize(lightPos.xyz - fPosEye.xyz);
     
     // compute view direction 
     vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
 
     // compute distance to the light source
-    float dist = length(lightPos - fPosEye.xyz);
+    float dist = length(lightPos.xyz - fPosEye.xyz);
     float att = 1.0f / (constant + linear * dist + quadratic * (dist * dist));
         
     // compute ambient light
-    ambient = att * ambientStrength * lightColor;
+    ambient = att * ambientStrength * lightColor.rgb;
     
     // compute diffuse light
-    diffuse = att * max(dot(normalEye, lightDir), 0.0f) * lightColor;
+    diffuse = att * max(dot(normalEye, lightDirN), 0.0f) * lightColor.rgb;
     
     // compute specular light
-    vec3 reflection = reflect(-lightDir, normalEye);
+    vec3 reflection = reflect(-lightDirN, normalEye);
     float specCoeff = pow(max(dot(viewDirN, reflection), 0.0f), shininess);
-    specular = att * specularStrength * specCoeff * lightColor;
+    specular = att * specularStrength * specCoeff * lightColor.rgb;
 }
 
 void main() 
@@ -8,25 +8,50 @@ out vec3 fNormal;
 out vec4 fPosEye;
 out vec2 fragTexCoords; // Add this line
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat3 normalMatrix;
+// Quantized meshes: positions are unorm16 inside [positionMin, positionMin + positionExtent]
+// and normals are octahedral-encoded in vNormal.xy. Float meshes use an identity range.
+uniform bool quantizedVertices;
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
 
-uniform mat4 airportModel;  // Airport transformation matrix
-uniform mat4 airplaneModel; // Airplane transformation matrix
-uniform int objectID; // 0 for airport, 1 for airplane
+// Node transform of glTF submeshes, applied before the model matrix. Identity for the others.
+uniform mat4 nodeMatrix;
+uniform mat3 nodeNormalMatrix; // inverse transpose of nodeMatrix
+
+// Shared by every draw of a frame
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightDir;
+    vec4 lightColor;
+    vec4 lightPos;
+};
+
+// Bound per drawn object
+layout(std140) uniform ObjectUniforms
+{
+    mat4 model;
+    mat4 normalMatrix; // upper 3x3 used
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
 
 void main() 
 {
+    vec3 position = vec3(nodeMatrix * vec4(positionMin + vPosition * positionExtent, 1.0f));
+    vec3 normal = nodeNormalMatrix * (quantizedVertices ? decodeOctahedral(vNormal.xy) : vNormal);
+
     // compute eye space coordinates
-    mat4 model;
-    if (objectID == 0) {
-        model = airportModel;
-    } else if (objectID == 1) {
-        model = airplaneModel;
-    }
-    fPosEye = view * model * vec4(vPosition, 1.0f);
-    fNormal = normalize(normalMatrix * vNormal);
+    fPosEye = view * model * vec4(position, 1.0f);
+    fNormal = normalize(mat3(normalMatrix) * normal);
     fragTexCoords = vTexCoords; // Add this line
-    gl_Position = projection * view * model * vec4(vPosition, 1.0f);
+    gl_Position = projection * view * model * vec4(position, 1.0f);
 }
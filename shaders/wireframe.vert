@@ -1,8 +1,14 @@
 #version 410 core
 layout(location = 0) in vec3 aPos;
 
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 lightDir;
+    vec4 lightColor;
+    vec4 lightPos;
+};
 
 void main() {
     gl_Position = projection * view * vec4(aPos, 1.0);